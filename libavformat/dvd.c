@@ -22,49 +22,353 @@
 
 /*
  * TODO
- * Add (fix?) seeking
- * Get size of title
- * Add -chapter support
  * Accurate errors / exits
  * Process small / broken titles < 1 second (fex title 1 in HTTYD)
- * Debug things starting at correct sector offset (title 16 is game trailer, but showing up on other tracks)
  */
 
+#include "config.h"
+
+#include <stdatomic.h>
+
 #include <dvdread/dvd_reader.h>
 #include <dvdread/ifo_read.h>
 
+#include "libavutil/avassert.h"
 #include "libavutil/avstring.h"
+#include "libavutil/bprint.h"
+#include "libavutil/file.h"
+#include "libavutil/random_seed.h"
+#include "libavutil/time.h"
 #include "libavformat/avformat.h"
+#include "libavformat/internal.h"
 #include "libavformat/url.h"
 #include "libavutil/opt.h"
+#include "libavutil/thread.h"
 
 #define DVD_PROTO_PREFIX     "dvd:"
 #ifndef DVD_VIDEO_LB_LEN
 #define DVD_VIDEO_LB_LEN 2048
 #endif
 
+enum {
+    DVD_BAD_SECTOR_FAIL,
+    DVD_BAD_SECTOR_ZERO,
+    DVD_BAD_SECTOR_DROP,
+};
+
+/* read latency buckets in powers of two microseconds, the last one catches everything slower */
+#define DVD_LATENCY_BUCKETS 24
+
+#define DVD_CACHE_MAGIC   MKTAG('D','V','D','M')
+#define DVD_CACHE_VERSION 3
+
+/*
+ * Title map: what dvd_open() needs from the IFOs, in a flat layout that can
+ * be written to and memory-mapped from the IFO cache as is.
+ */
+typedef struct DVDCellInfo {
+    uint32_t first_sector;
+    uint32_t last_sector;
+    uint32_t playback_time;     /* milliseconds */
+    uint8_t  block_type;
+    uint8_t  block_mode;
+    uint8_t  interleaved;       /* ILVUs of other angles or paths between its sectors */
+    uint8_t  reserved;
+} DVDCellInfo;
+
+/*
+ * The cells of a title are those of every program chain its PTTs point to,
+ * one chain after the other. A chapter is a PTT, kept as the number of its
+ * entry cell in that list.
+ */
+typedef struct DVDTitleInfo {
+    uint8_t  title_set;
+    uint8_t  vts_ttn;
+    uint8_t  nr_of_angles;
+    uint8_t  nr_of_pgcs;
+    uint16_t pgcn;              /* first program chain */
+    uint16_t nr_of_cells;       /* 0 if the title was not parsed */
+    uint16_t nr_of_chapters;
+    uint16_t reserved;
+    uint32_t cell_idx;          /* first entry in the cell table */
+    uint32_t chapter_idx;       /* first entry in the chapter table */
+    uint32_t playback_time;     /* milliseconds */
+} DVDTitleInfo;
+
+typedef struct DVDCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint8_t  disc_id[16];
+    uint32_t nb_titles;
+    uint32_t nb_cells;
+    uint32_t nb_chapters;
+    uint32_t reserved;
+} DVDCacheHeader;
+
+/* contiguous run of sectors in the title set VOBs, one per played cell */
+typedef struct DVDRange {
+    int cell;
+    uint32_t first_sector;
+    uint32_t last_sector;
+    int64_t pos;
+    uint32_t time;          /* start of the cell in the title, milliseconds */
+    uint32_t duration;
+} DVDRange;
+
+/* sector cache, shared by every open of the process */
+#define DVD_EXTENT_SECTORS 64
+#define DVD_SECTOR_CACHE_BUCKETS 1024
+
+typedef struct DVDCacheExtent {
+    int disc;               /* index into DVDSectorCache.discs */
+    int title_set;
+    uint32_t extent;        /* first sector / DVD_EXTENT_SECTORS */
+    uint64_t valid;         /* one bit per sector */
+    struct DVDCacheExtent *hash_next;
+    struct DVDCacheExtent *lru_prev, *lru_next;
+    uint8_t data[DVD_EXTENT_SECTORS * DVD_VIDEO_LB_LEN];
+} DVDCacheExtent;
+
+typedef struct DVDSectorCache {
+    DVDCacheExtent *hash[DVD_SECTOR_CACHE_BUCKETS];
+    DVDCacheExtent *lru_head, *lru_tail;    /* most recently used first */
+    int64_t size, max_size;
+    char **discs;
+    int nb_discs;
+    int users;
+} DVDSectorCache;
+
+static DVDSectorCache sector_cache;
+static AVMutex sector_cache_lock = AV_MUTEX_INITIALIZER;
+
+/* reader and IFOs shared by every open of the same disc path */
+typedef struct DVDSharedDisc {
+    char *path;
+    char disc_id[33];           /* the media in the drive or image at path when it was opened */
+    int users;
+    dvd_reader_t *dvd;
+    ifo_handle_t *ifo[100];     /* VMG at 0, title sets at 1..99, opened on first use */
+    AVMutex lock;               /* held around libdvdread calls on dvd */
+    struct DVDSharedDisc *next;
+} DVDSharedDisc;
+
+static DVDSharedDisc *disc_pool;
+static AVMutex disc_pool_lock = AV_MUTEX_INITIALIZER;
+
+/* candidate for title=auto */
+typedef struct DVDTitleRank {
+    int title;
+    uint32_t playback_time;
+    uint32_t sectors;       /* each cell counted once, however often it plays */
+    int chapters;
+    int looping;            /* too few sectors for its playback time */
+} DVDTitleRank;
+
+/* one played cell of a title being extracted, and where it goes in the title's output */
+typedef struct DVDExtractPiece {
+    int output;
+    int cell;
+    uint32_t first_sector;
+    uint32_t last_sector;
+    int64_t pos;
+} DVDExtractPiece;
+
+typedef struct DVDExtractOutput {
+    int title;
+    URLContext *url;
+    int64_t size;
+    int64_t pos;            /* where the next write goes without seeking */
+} DVDExtractOutput;
+
+/* sectors per read when reading whole cells ahead and blocks_per_read is not set */
+#define DVD_BULK_BLOCKS 512
+
 typedef struct {
     const AVClass *class;
 
     dvd_reader_t *dvd;
+    DVDSharedDisc *shared;  /* NULL when dvd, vmg and vts are owned */
+    int share_disc;
+    char disc_id[33];       /* hex DVDDiscID(), empty until needed or if it failed */
     ifo_handle_t *vmg;
     ifo_handle_t *vts;
     dvd_file_t *file;
-    int blocks;
+    int64_t blocks;         /* sectors in the read plan */
     int cells;
     int chapters;
-    int size;
-    int offset;
+    int64_t size;           /* bytes in the read plan */
+    int64_t offset;         /* sectors handed out so far */
     int title_set;
 
+    /* title map, either parsed from the IFOs or pointing into cache_buf */
+    DVDTitleInfo *titles;
+    int nb_titles;
+    DVDCellInfo *cell_info;
+    int nb_cell_info;
+    uint16_t *chapter_cells;
+    int nb_chapter_cells;
+    uint8_t *cache_buf;
+    size_t cache_size;
+
+    DVDRange *ranges;
+    int nb_ranges;
+    int cur_range;
+    uint32_t sector;
+    uint32_t start_time;
+
     int title;
-    // int chapter;
+    int chapter_start;
+    int chapter_end;
+    int blocks_per_read;
+    char *ifo_cache_dir;
+    int vobu_index;
+    char *keyframe_index;
+    char *title_ranking;
+    int list_titles;
+    char *title_list;
+    int ifo_streams;
+    char *streams;
+    char *chapter_list;
+    char *extract_titles;
+    char *extract_output;
+    char *extracted;
+    int pgc;
+    int cell_filter;
+    uint8_t *cell_score;
+    char *filtered_cells;
+
+    /* I/O statistics, exported */
+    int64_t stat_sectors;
+    int64_t stat_calls;
+    int64_t stat_short_reads;
+    int64_t stat_retries;
+    int64_t stat_read_time;
+    int64_t stat_cells;
+    int64_t stat_bytes_skipped;
+    int stat_last_range;
+    int64_t latency_hist[DVD_LATENCY_BUCKETS];
+
+    /* slow read tracing */
+    char *trace_file;
+    int64_t slow_read;
+    URLContext *trace;
+    int64_t trace_start;
+    int trace_events;
+
+    /* unreadable sectors */
+    int bad_sector;
+    int retries;
+    int64_t retry_delay;
+    int skip_sectors;
+    int skip_size;
+    int skip_left;
+    atomic_int dropped;         /* set by whichever thread reads, once a sector is dropped */
+    uint32_t (*skipped)[2];
+    int nb_skipped;
+    char *skipped_ranges;
+    int64_t bad_sectors;        /* counted by the reading thread, published to stat_bad_sectors */
+    int64_t stat_bad_sectors;
+
+    /* sector cache */
+    int64_t sector_cache_size;
+    int sector_cache_disc;      /* -1 when not using the cache */
+    uint8_t *sector_cache_buf;
+    int64_t sector_cache_bad;   /* extent a miss failed to read whole, -1 if none */
+    int64_t stat_cache_hits;
+    int64_t stat_cache_misses;
+
+    /* cells read ahead of their turn to keep to disc order, one buffer per range */
+    int reorder_size;
+    uint8_t **reorder_buf;
+    int *reorder_list;
+    int64_t reorder_used;
+    int reordering;
+    int64_t stat_reordered;
+
+    /* start of the title kept in memory for probing */
+    int probe_window;
+    uint8_t *probe_buf;
+    int probe_len;
+    int64_t probe_pos;      /* position inside probe_buf being read from, -1 when reading the disc */
+
+    /* bounce buffer for callers asking for less than a sector */
+    uint8_t sector_buf[DVD_VIDEO_LB_LEN];
+    int sector_pos;
+    int sector_len;
+    int sector_skip;
+
+    int readahead;
+    int readahead_size;
+    int readahead_low;
+    int readahead_high;
+#if HAVE_THREADS
+    /* single producer, single consumer ring of sectors filled by the worker */
+    pthread_t ra_thread;
+    pthread_mutex_t ra_mutex;
+    pthread_cond_t ra_cond_data;
+    pthread_cond_t ra_cond_space;
+    int ra_mutex_inited;
+    int ra_thread_started;
+    uint8_t *ra_ring;
+    atomic_uint ra_head;
+    atomic_uint ra_tail;
+    atomic_int ra_abort;
+    int ra_done;
+    int ra_error;
+#endif
 } DVDContext;
 
 #define OFFSET(x) offsetof(DVDContext, x)
 static const AVOption options[] = {
-{"title", "", OFFSET(title), AV_OPT_TYPE_INT, { .i64=-1 }, -1, 99999, AV_OPT_FLAG_DECODING_PARAM },
-// {"chapter",  "", OFFSET(chapter),  AV_OPT_TYPE_INT, { .i64=1 },   1, 0xfffe, AV_OPT_FLAG_DECODING_PARAM },
+{"title", "", OFFSET(title), AV_OPT_TYPE_INT, { .i64=-1 }, -1, 99999, AV_OPT_FLAG_DECODING_PARAM, "title" },
+    {"auto", "pick the main feature", 0, AV_OPT_TYPE_CONST, { .i64=0 }, 0, 0, AV_OPT_FLAG_DECODING_PARAM, "title" },
+{"title_ranking", "space separated title:milliseconds:sectors:chapters, best first, set by title=auto, exported", OFFSET(title_ranking), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"chapter_start", "first chapter to read", OFFSET(chapter_start), AV_OPT_TYPE_INT, { .i64=1 }, 1, 999, AV_OPT_FLAG_DECODING_PARAM },
+{"chapter_end", "last chapter to read, 0 for the last chapter of the title", OFFSET(chapter_end), AV_OPT_TYPE_INT, { .i64=0 }, 0, 999, AV_OPT_FLAG_DECODING_PARAM },
+{"list_titles", "only describe the titles in title_list, without opening any VOB", OFFSET(list_titles), AV_OPT_TYPE_BOOL, { .i64=0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+{"title_list", "JSON array describing every title, set by list_titles, exported", OFFSET(title_list), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"ifo_streams", "export the streams of the title described by the title set IFO", OFFSET(ifo_streams), AV_OPT_TYPE_BOOL, { .i64=0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+{"streams", "JSON array of the streams of the title with their MPEG-PS stream IDs, set by ifo_streams, exported", OFFSET(streams), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"chapters", "chapters of the selection in FFMETADATA1 form, times in milliseconds, exported", OFFSET(chapter_list), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"extract_titles", "comma separated titles, or all for every unique title, to write to extract_output in one pass over the disc", OFFSET(extract_titles), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
+{"extract_output", "output URL of each extracted title, %d is replaced by the title number", OFFSET(extract_output), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
+{"extracted", "space separated title:bytes of the titles written by extract_titles, exported", OFFSET(extracted), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"pgc", "program chain of the title set to play instead of the title's own, 0 for the title's", OFFSET(pgc), AV_OPT_TYPE_INT, { .i64=0 }, 0, 32767, AV_OPT_FLAG_DECODING_PARAM },
+{"cell_filter", "leave out cells with at least this many signs of structure protection, 0 to keep all cells", OFFSET(cell_filter), AV_OPT_TYPE_INT, { .i64=0 }, 0, 8, AV_OPT_FLAG_DECODING_PARAM },
+{"filtered_cells", "space separated cell:score pairs of the cells left out, exported", OFFSET(filtered_cells), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"readahead", "read sectors in a background thread", OFFSET(readahead), AV_OPT_TYPE_BOOL, { .i64=0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+{"readahead_size", "readahead ring size in sectors", OFFSET(readahead_size), AV_OPT_TYPE_INT, { .i64=1024 }, 16, INT_MAX / DVD_VIDEO_LB_LEN, AV_OPT_FLAG_DECODING_PARAM },
+{"readahead_low", "resume reading ahead when the ring drops to this many sectors, 0 for a quarter of the ring", OFFSET(readahead_low), AV_OPT_TYPE_INT, { .i64=0 }, 0, INT_MAX, AV_OPT_FLAG_DECODING_PARAM },
+{"readahead_high", "pause reading ahead when the ring holds this many sectors, 0 for the whole ring", OFFSET(readahead_high), AV_OPT_TYPE_INT, { .i64=0 }, 0, INT_MAX, AV_OPT_FLAG_DECODING_PARAM },
+{"ifo_cache_dir", "directory to cache parsed title maps in, keyed by disc ID", OFFSET(ifo_cache_dir), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
+{"vobu_index", "export a keyframe index built from the VOBU address map", OFFSET(vobu_index), AV_OPT_TYPE_BOOL, { .i64=0 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+{"keyframe_index", "space separated pos:timestamp pairs, one per VOBU, timestamps in AV_TIME_BASE", OFFSET(keyframe_index), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"sectors_read", "number of sectors read, exported", OFFSET(stat_sectors), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"read_calls", "number of DVDReadBlocks() calls, exported", OFFSET(stat_calls), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"short_reads", "number of reads returning fewer sectors than asked or failing, exported", OFFSET(stat_short_reads), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"read_retries", "number of retried reads, exported", OFFSET(stat_retries), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"read_time", "microseconds spent in DVDReadBlocks(), exported", OFFSET(stat_read_time), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"cells_read", "number of cells read from, exported", OFFSET(stat_cells), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"bytes_skipped", "bytes of the title set left out by cell and chapter selection, exported", OFFSET(stat_bytes_skipped), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"trace_file", "write reads slower than slow_read to this file as Chrome trace JSON", OFFSET(trace_file), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM },
+{"slow_read", "trace and log reads taking at least this many microseconds, 0 to disable", OFFSET(slow_read), AV_OPT_TYPE_INT64, { .i64=100000 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM },
+{"bad_sector", "what to do with sectors that cannot be read", OFFSET(bad_sector), AV_OPT_TYPE_INT, { .i64=DVD_BAD_SECTOR_ZERO }, 0, 2, AV_OPT_FLAG_DECODING_PARAM, "bad_sector" },
+    {"fail", "return an error", 0, AV_OPT_TYPE_CONST, { .i64=DVD_BAD_SECTOR_FAIL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM, "bad_sector" },
+    {"zero", "skip and replace with zeros", 0, AV_OPT_TYPE_CONST, { .i64=DVD_BAD_SECTOR_ZERO }, 0, 0, AV_OPT_FLAG_DECODING_PARAM, "bad_sector" },
+    {"drop", "skip and leave out of the output, seeking fails once a sector is dropped", 0, AV_OPT_TYPE_CONST, { .i64=DVD_BAD_SECTOR_DROP }, 0, 0, AV_OPT_FLAG_DECODING_PARAM, "bad_sector" },
+{"retries", "number of times an unreadable sector is retried", OFFSET(retries), AV_OPT_TYPE_INT, { .i64=3 }, 0, 16, AV_OPT_FLAG_DECODING_PARAM },
+{"retry_delay", "microseconds to wait before the first retry, doubled on each further retry", OFFSET(retry_delay), AV_OPT_TYPE_INT64, { .i64=10000 }, 0, 10000000, AV_OPT_FLAG_DECODING_PARAM },
+{"skip_sectors", "sectors to skip past an unreadable sector, doubled while reads keep failing", OFFSET(skip_sectors), AV_OPT_TYPE_INT, { .i64=16 }, 1, 1 << 20, AV_OPT_FLAG_DECODING_PARAM },
+{"skipped_ranges", "space separated first-last VOB sectors skipped as unreadable, exported", OFFSET(skipped_ranges), AV_OPT_TYPE_STRING, { .str=NULL }, 0, 0, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"bad_sectors", "number of sectors skipped as unreadable, exported", OFFSET(stat_bad_sectors), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"sector_cache", "bytes of sectors to keep in an LRU cache shared by every open of the process, 0 to disable", OFFSET(sector_cache_size), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM },
+{"cache_hits", "reads served from the sector cache, exported", OFFSET(stat_cache_hits), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"cache_misses", "reads the sector cache had to pass to the disc, exported", OFFSET(stat_cache_misses), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"reorder_size", "bytes of cells that may be read ahead of their turn so the cells of a title are read in disc order, 0 to read in playback order", OFFSET(reorder_size), AV_OPT_TYPE_INT, { .i64=0 }, 0, INT_MAX, AV_OPT_FLAG_DECODING_PARAM },
+{"cells_reordered", "cells read ahead of their turn, exported", OFFSET(stat_reordered), AV_OPT_TYPE_INT64, { .i64=0 }, 0, INT64_MAX, AV_OPT_FLAG_DECODING_PARAM | AV_OPT_FLAG_EXPORT | AV_OPT_FLAG_READONLY },
+{"probe_window", "keep this many bytes from the start of the title in memory, so probing can rewind without rereading", OFFSET(probe_window), AV_OPT_TYPE_INT, { .i64=0 }, 0, 256 << 20, AV_OPT_FLAG_DECODING_PARAM },
+{"share_disc", "share the disc reader and IFOs with other opens of the same path", OFFSET(share_disc), AV_OPT_TYPE_BOOL, { .i64=1 }, 0, 1, AV_OPT_FLAG_DECODING_PARAM },
+{"blocks_per_read", "maximum number of sectors per read, 0 to fill the caller's buffer", OFFSET(blocks_per_read), AV_OPT_TYPE_INT, { .i64=0 }, 0, INT_MAX / DVD_VIDEO_LB_LEN, AV_OPT_FLAG_DECODING_PARAM },
 {NULL}
 };
 
@@ -75,186 +379,3041 @@ static const AVClass dvd_context_class = {
     .version        = LIBAVUTIL_VERSION_INT,
 };
 
-static int check_disc_info(URLContext *h)
+static int trace_open(URLContext *h)
 {
     DVDContext *dvd = h->priv_data;
-    const ifo_handle_t *disc_info;
+    int ret;
 
-    disc_info = ifoOpen(dvd->dvd, 0);
-    if (!disc_info) {
-        av_log(h, AV_LOG_ERROR, "ifoOpen() failed\n");
-        return -1;
+    ret = ffurl_open_whitelist(&dvd->trace, dvd->trace_file, AVIO_FLAG_WRITE, &h->interrupt_callback, NULL,
+                               h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret < 0) {
+        av_log(h, AV_LOG_ERROR, "could not open trace file %s: %s\n", dvd->trace_file, av_err2str(ret));
+        return ret;
     }
+    dvd->trace_start = av_gettime_relative();
+    dvd->trace_events = 0;
 
-    return 0;
+    return ffurl_write(dvd->trace, (const unsigned char *)"[", 1);
 }
 
-static int dvd_close(URLContext *h)
+static void trace_close(DVDContext *dvd)
+{
+    if (!dvd->trace) {
+        return;
+    }
+    ffurl_write(dvd->trace, (const unsigned char *)"\n]\n", 3);
+    ffurl_closep(&dvd->trace);
+}
+
+static void trace_slow_read(URLContext *h, int range, uint32_t sector, int blocks,
+                            int ret, int64_t start, int64_t duration)
 {
     DVDContext *dvd = h->priv_data;
+    char event[384];
+    int len;
 
-    if (dvd->vmg) {
-        ifoClose(dvd->vmg);
+    av_log(h, AV_LOG_VERBOSE, "slow read: cell %d, sector %u, %d sectors, %"PRId64" ms\n",
+           dvd->ranges[range].cell, sector, blocks, duration / 1000);
+
+    if (!dvd->trace) {
+        return;
     }
 
-    if (dvd->vts) {
-        ifoClose(dvd->vts);
+    /* complete events, times in microseconds from the open */
+    len = snprintf(event, sizeof(event),
+                   "%s\n{\"name\":\"DVDReadBlocks\",\"cat\":\"dvd\",\"ph\":\"X\",\"pid\":1,\"tid\":1,"
+                   "\"ts\":%"PRId64",\"dur\":%"PRId64",\"args\":{\"title\":%d,\"cell\":%d,"
+                   "\"sector\":%u,\"sectors\":%d,\"result\":%d}}",
+                   dvd->trace_events ? "," : "", start - dvd->trace_start, duration,
+                   dvd->title, dvd->ranges[range].cell, sector, blocks, ret);
+    if (ffurl_write(dvd->trace, (const unsigned char *)event, len) < 0) {
+        av_log(h, AV_LOG_WARNING, "could not write to trace file %s, tracing stopped\n", dvd->trace_file);
+        ffurl_closep(&dvd->trace);
+        return;
     }
+    dvd->trace_events++;
+}
 
-    if (dvd->dvd) {
-        DVDClose(dvd->dvd);
+/*
+ * The same path can hold another disc later, a drive after a media change
+ * or a replaced image, so whatever is shared between opens is keyed by the
+ * disc ID too.
+ */
+static int disc_identify(dvd_reader_t *reader, char *hex)
+{
+    unsigned char disc_id[16];
+    int i;
+
+    if (DVDDiscID(reader, disc_id) < 0) {
+        hex[0] = 0;
+        return AVERROR(EIO);
+    }
+    for (i = 0; i < 16; i++) {
+        snprintf(hex + 2 * i, 3, "%02x", disc_id[i]);
     }
 
     return 0;
 }
 
-static int dvd_open(URLContext *h, const char *path, int flags)
+static DVDSharedDisc *disc_find(const char *path, const char *disc_id)
 {
-    DVDContext *dvd = h->priv_data;
-    int num_title_idx;
-    int ttn;
-    const char *diskname = path;
+    DVDSharedDisc *disc;
 
-    pgcit_t *vts_pgcit;
-    pgc_t *pgc;
+    for (disc = disc_pool; disc; disc = disc->next) {
+        if (!strcmp(disc->path, path) && !strcmp(disc->disc_id, disc_id)) {
+            break;
+        }
+    }
 
-    av_strstart(path, DVD_PROTO_PREFIX, &diskname);
+    return disc;
+}
+
+/*
+ * Opening a disc reads from the drive and may take seconds, so it is done
+ * without the pool lock. The new reader is what tells which disc is in the
+ * drive, it is dropped for the pooled one of the same disc if there is one.
+ * Whichever of two racing opens inserts its reader first wins.
+ */
+static int disc_acquire(URLContext *h, const char *path)
+{
+    DVDContext *dvd = h->priv_data;
+    DVDSharedDisc *disc, *found;
+    dvd_reader_t *reader;
 
-    dvd->dvd = DVDOpen(diskname);
-    if (dvd->dvd == 0) {
+    reader = DVDOpen(path);
+    if (!reader) {
         av_log(h, AV_LOG_ERROR, "DVDOpen() failed\n");
         return AVERROR(EIO);
     }
+    if (disc_identify(reader, dvd->disc_id) < 0) {
+        av_log(h, AV_LOG_VERBOSE, "DVDDiscID() failed, not sharing the reader of %s\n", path);
+        dvd->dvd = reader;
+        return 0;
+    }
 
-    /* check if disc can be played */
-    if (check_disc_info(h) < 0) {
-        return AVERROR(EIO);
+    disc = av_mallocz(sizeof(*disc));
+    if (!disc || !(disc->path = av_strdup(path))) {
+        av_free(disc);
+        DVDClose(reader);
+        return AVERROR(ENOMEM);
     }
+    disc->dvd = reader;
+    memcpy(disc->disc_id, dvd->disc_id, sizeof(disc->disc_id));
+    ff_mutex_init(&disc->lock, NULL);
 
-    /* load DVD info */
-    dvd->vmg = ifoOpen(dvd->dvd, 0);
-    if (dvd->vmg == NULL || dvd->vmg->vmgi_mat == NULL || dvd->vmg->tt_srpt == NULL) {
-        return AVERROR(EIO);
+    ff_mutex_lock(&disc_pool_lock);
+    found = disc_find(path, disc->disc_id);
+    if (!found) {
+        disc->next = disc_pool;
+        disc_pool = disc;
+        found = disc;
+    } else {
+        av_log(h, AV_LOG_DEBUG, "sharing the reader of %s with %d other opens\n", path, found->users);
     }
+    found->users++;
+    dvd->shared = found;
+    dvd->dvd = found->dvd;
+    ff_mutex_unlock(&disc_pool_lock);
 
-    /* load title list */
-    num_title_idx = dvd->vmg->tt_srpt->nr_of_srpts;
-    av_log(h, AV_LOG_INFO, "%d usable titles\n", num_title_idx);
-    if (num_title_idx < 1) {
-        return AVERROR(EIO);
+    if (found != disc) {
+        DVDClose(disc->dvd);
+        ff_mutex_destroy(&disc->lock);
+        av_free(disc->path);
+        av_free(disc);
     }
+    return 0;
+}
 
-    /* play first title if none is given or exceeds boundary */
-    if (dvd->title < 1 || dvd->title > num_title_idx) {
-        av_log(h, AV_LOG_DEBUG, "title selection %d out of bounds, switching to title 1\n", dvd->title);
-        dvd->title = 1;
+/* the last user closes the reader and every IFO opened through it */
+static void disc_release(DVDContext *dvd)
+{
+    DVDSharedDisc *disc = dvd->shared, **p;
+    int i, last;
+
+    if (!disc) {
+        return;
     }
+    dvd->shared = NULL;
+    dvd->dvd = NULL;
 
-    av_log(h, AV_LOG_INFO, "selected title %d\n", dvd->title);
+    ff_mutex_lock(&disc_pool_lock);
+    last = !--disc->users;
+    if (last) {
+        for (p = &disc_pool; *p != disc; p = &(*p)->next) {
+        }
+        *p = disc->next;
+    }
+    ff_mutex_unlock(&disc_pool_lock);
 
-    /* select video title set */
-    dvd->title_set = dvd->vmg->tt_srpt->title[dvd->title - 1].title_set_nr;
-    av_log(h, AV_LOG_DEBUG, "selected video title set %d\n", dvd->title_set);
+    /* out of the pool, nobody else can reach it */
+    if (last) {
+        for (i = 0; i < FF_ARRAY_ELEMS(disc->ifo); i++) {
+            if (disc->ifo[i]) {
+                ifoClose(disc->ifo[i]);
+            }
+        }
+        DVDClose(disc->dvd);
+        ff_mutex_destroy(&disc->lock);
+        av_free(disc->path);
+        av_free(disc);
+    }
+}
 
-    /* load title set IFO */
-    dvd->vts = ifoOpen(dvd->dvd, dvd->title_set);
-    if(dvd->vts == NULL || dvd->vts->vtsi_mat == NULL) {
-        av_log(h, AV_LOG_ERROR, "Opening video title set failed\n");
-        return AVERROR(EIO);
+/* libdvdread keeps one file position per reader, so calls on a shared one are serialized */
+static void disc_lock(DVDContext *dvd)
+{
+    if (dvd->shared) {
+        ff_mutex_lock(&dvd->shared->lock);
+    }
+}
+
+static void disc_unlock(DVDContext *dvd)
+{
+    if (dvd->shared) {
+        ff_mutex_unlock(&dvd->shared->lock);
     }
+}
 
-    /* sanity checks on video title set */
-    if(dvd->vts->vts_pgcit == NULL || dvd->vts->vts_ptt_srpt == NULL || dvd->vts->vts_ptt_srpt->title == NULL) {
-        av_log(h, AV_LOG_ERROR, "Video title set is empty\n");
-        return AVERROR(EIO);
+/* the VMG for title set 0, handles of a shared disc are read only and closed with it */
+static ifo_handle_t *open_ifo(DVDContext *dvd, int title_set)
+{
+    ifo_handle_t *ifo;
+
+    if (!dvd->shared) {
+        return ifoOpen(dvd->dvd, title_set);
     }
 
-    /* open DVD file */
-    dvd->file = DVDOpenFile(dvd->dvd, dvd->title_set, DVD_READ_TITLE_VOBS);
-    if (dvd->file == 0) {
-        return AVERROR(EIO);
+    disc_lock(dvd);
+    ifo = dvd->shared->ifo[title_set];
+    if (!ifo) {
+        ifo = dvd->shared->ifo[title_set] = ifoOpen(dvd->dvd, title_set);
     }
+    disc_unlock(dvd);
 
-    /* get ttn */
-    ttn = dvd->vmg->tt_srpt->title[dvd->title - 1].vts_ttn;
-    av_log(h, AV_LOG_INFO, "DVD TTN: %d\n", ttn);
+    return ifo;
+}
 
-    /* open the program chain */
-    vts_pgcit = dvd->vts->vts_pgcit;
-    pgc = vts_pgcit->pgci_srp[dvd->vts->vts_ptt_srpt->title[ttn - 1].ptt[0].pgcn - 1].pgc;
-    if(vts_pgcit->pgci_srp[dvd->vts->vts_ptt_srpt->title[ttn - 1].ptt[0].pgcn - 1].pgc == NULL) {
-        av_log(h, AV_LOG_ERROR, "Program chain is broken\n");
-        return AVERROR(EIO);
+static void close_ifo(DVDContext *dvd, ifo_handle_t *ifo)
+{
+    if (!dvd->shared) {
+        ifoClose(ifo);
     }
-    if(pgc == NULL || pgc->cell_playback == NULL) {
-        av_log(h, AV_LOG_ERROR, "Program chain is empty\n");
-        return AVERROR(EIO);
+}
+
+/* all sector reads go through here, from the demuxing thread or the readahead worker */
+static int read_blocks(URLContext *h, int range, uint32_t sector, int blocks, uint8_t *buf)
+{
+    DVDContext *dvd = h->priv_data;
+    int64_t start, duration;
+    int ret;
+
+    /* time only libdvdread, not the wait for other opens of a shared disc */
+    disc_lock(dvd);
+    start = av_gettime_relative();
+    ret = DVDReadBlocks(dvd->file, sector, blocks, buf);
+    duration = av_gettime_relative() - start;
+    disc_unlock(dvd);
+
+    dvd->latency_hist[FFMIN(av_log2(FFMIN(duration, INT_MAX) | 1), DVD_LATENCY_BUCKETS - 1)]++;
+    if (dvd->slow_read > 0 && duration >= dvd->slow_read) {
+        trace_slow_read(h, range, sector, blocks, ret, start, duration);
     }
 
-    /* cells */
-    dvd->cells = pgc->nr_of_cells;
-    av_log(h, AV_LOG_DEBUG, "number of cells for title: %d\n", dvd->cells);
+    dvd->stat_read_time += duration;
+    dvd->stat_calls++;
+    if (ret > 0) {
+        dvd->stat_sectors += ret;
+    }
+    if (ret < blocks) {
+        dvd->stat_short_reads++;
+    }
+    if (range != dvd->stat_last_range) {
+        dvd->stat_last_range = range;
+        dvd->stat_cells++;
+    }
 
-    /* chapters */
-    dvd->chapters = pgc->nr_of_programs;
-    av_log(h, AV_LOG_DEBUG, "number of chapters for title: %d\n", dvd->chapters);
+    return ret;
+}
 
-    dvd->blocks = DVDFileSize(dvd->file);
-    dvd->size = dvd->blocks * DVD_VIDEO_LB_LEN;
+/* extents are kept per disc ID, not per path, so a media change never serves the old disc */
+static int sector_cache_join(URLContext *h, const char *disc)
+{
+    DVDContext *dvd = h->priv_data;
+    char **discs;
+    int i, ret = 0;
 
-    /* set cell block offset */
-    dvd->offset = 0;
+    dvd->sector_cache_buf = av_malloc(DVD_EXTENT_SECTORS * DVD_VIDEO_LB_LEN);
+    if (!dvd->sector_cache_buf) {
+        return AVERROR(ENOMEM);
+    }
 
-    return 0;
+    ff_mutex_lock(&sector_cache_lock);
+    for (i = 0; i < sector_cache.nb_discs; i++) {
+        if (!strcmp(sector_cache.discs[i], disc)) {
+            break;
+        }
+    }
+    if (i == sector_cache.nb_discs) {
+        discs = av_realloc_array(sector_cache.discs, i + 1, sizeof(*discs));
+        if (!discs) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        sector_cache.discs = discs;
+        if (!(discs[i] = av_strdup(disc))) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        sector_cache.nb_discs++;
+    }
+    dvd->sector_cache_disc = i;
+    sector_cache.max_size = FFMAX(sector_cache.max_size, dvd->sector_cache_size);
+    sector_cache.users++;
+end:
+    ff_mutex_unlock(&sector_cache_lock);
+    return ret;
 }
 
-static int dvd_read(URLContext *h, unsigned char *buf, int size)
+static DVDCacheExtent **sector_cache_bucket(int disc, int title_set, uint32_t extent)
+{
+    return &sector_cache.hash[(extent ^ (uint32_t)title_set << 16 ^ (uint32_t)disc << 24) % DVD_SECTOR_CACHE_BUCKETS];
+}
+
+static void sector_cache_unlink(DVDCacheExtent *e)
+{
+    DVDCacheExtent **p = sector_cache_bucket(e->disc, e->title_set, e->extent);
+
+    while (*p != e) {
+        p = &(*p)->hash_next;
+    }
+    *p = e->hash_next;
+
+    if (e->lru_prev) {
+        e->lru_prev->lru_next = e->lru_next;
+    } else {
+        sector_cache.lru_head = e->lru_next;
+    }
+    if (e->lru_next) {
+        e->lru_next->lru_prev = e->lru_prev;
+    } else {
+        sector_cache.lru_tail = e->lru_prev;
+    }
+}
+
+static void sector_cache_leave(DVDContext *dvd)
+{
+    av_freep(&dvd->sector_cache_buf);
+    if (dvd->sector_cache_disc < 0) {
+        return;
+    }
+    dvd->sector_cache_disc = -1;
+
+    /* the last user frees everything */
+    ff_mutex_lock(&sector_cache_lock);
+    if (!--sector_cache.users) {
+        while (sector_cache.lru_head) {
+            DVDCacheExtent *e = sector_cache.lru_head;
+            sector_cache_unlink(e);
+            av_free(e);
+        }
+        while (sector_cache.nb_discs) {
+            av_free(sector_cache.discs[--sector_cache.nb_discs]);
+        }
+        av_freep(&sector_cache.discs);
+        sector_cache.size = sector_cache.max_size = 0;
+    }
+    ff_mutex_unlock(&sector_cache_lock);
+}
+
+/* call with sector_cache_lock held, moves a found extent to the front */
+static DVDCacheExtent *sector_cache_find(int disc, int title_set, uint32_t extent, int create)
+{
+    DVDCacheExtent **bucket = sector_cache_bucket(disc, title_set, extent);
+    DVDCacheExtent *e;
+
+    for (e = *bucket; e; e = e->hash_next) {
+        if (e->extent == extent && e->title_set == title_set && e->disc == disc) {
+            break;
+        }
+    }
+
+    if (e) {
+        sector_cache_unlink(e);
+    } else {
+        if (!create || sector_cache.max_size < sizeof(*e)) {
+            return NULL;
+        }
+        while (sector_cache.size + sizeof(*e) > sector_cache.max_size) {
+            DVDCacheExtent *old = sector_cache.lru_tail;
+            sector_cache_unlink(old);
+            av_free(old);
+            sector_cache.size -= sizeof(*old);
+        }
+        e = av_malloc(sizeof(*e));
+        if (!e) {
+            return NULL;
+        }
+        e->disc = disc;
+        e->title_set = title_set;
+        e->extent = extent;
+        e->valid = 0;
+        sector_cache.size += sizeof(*e);
+    }
+
+    e->hash_next = *bucket;
+    *bucket = e;
+    e->lru_prev = NULL;
+    e->lru_next = sector_cache.lru_head;
+    if (sector_cache.lru_head) {
+        sector_cache.lru_head->lru_prev = e;
+    } else {
+        sector_cache.lru_tail = e;
+    }
+    sector_cache.lru_head = e;
+
+    return e;
+}
+
+static uint64_t extent_mask(int first, int count)
+{
+    return (count == DVD_EXTENT_SECTORS ? ~UINT64_C(0) : (UINT64_C(1) << count) - 1) << first;
+}
+
+/*
+ * read_blocks() through the sector cache, never past the extent holding the
+ * first sector. A miss reads the extent up to the end of the cell, so the
+ * reads around it hit. If that fails, an unreadable sector may lie past the
+ * ones asked for, so they are read alone and so is every later miss in the
+ * extent.
+ */
+static int sector_cache_read(URLContext *h, int range, uint32_t sector, int blocks, uint8_t *buf)
 {
     DVDContext *dvd = h->priv_data;
-    int len;
-    int blocks;
+    uint32_t extent = sector / DVD_EXTENT_SECTORS;
+    int first = sector % DVD_EXTENT_SECTORS;
+    int count = FFMIN(dvd->ranges[range].last_sector, (extent + 1) * DVD_EXTENT_SECTORS - 1) - sector + 1;
+    DVDCacheExtent *e;
+    int ret;
 
-    if (!dvd || !dvd->dvd) {
-        return AVERROR(EFAULT);
+    blocks = FFMIN(blocks, count);
+
+    ff_mutex_lock(&sector_cache_lock);
+    e = sector_cache_find(dvd->sector_cache_disc, dvd->title_set, extent, 0);
+    if (e && (e->valid & extent_mask(first, blocks)) == extent_mask(first, blocks)) {
+        memcpy(buf, e->data + first * DVD_VIDEO_LB_LEN, blocks * DVD_VIDEO_LB_LEN);
+        ff_mutex_unlock(&sector_cache_lock);
+        dvd->stat_cache_hits++;
+        return blocks;
+    }
+    ff_mutex_unlock(&sector_cache_lock);
+    dvd->stat_cache_misses++;
+
+    ret = -1;
+    if (count > blocks && extent != dvd->sector_cache_bad) {
+        ret = read_blocks(h, range, sector, count, dvd->sector_cache_buf);
+        if (ret <= 0) {
+            dvd->sector_cache_bad = extent;
+        }
     }
+    if (ret <= 0) {
+        ret = read_blocks(h, range, sector, blocks, dvd->sector_cache_buf);
+        if (ret <= 0) {
+            return ret;
+        }
+    }
+
+    ff_mutex_lock(&sector_cache_lock);
+    e = sector_cache_find(dvd->sector_cache_disc, dvd->title_set, extent, 1);
+    if (e) {
+        memcpy(e->data + first * DVD_VIDEO_LB_LEN, dvd->sector_cache_buf, ret * DVD_VIDEO_LB_LEN);
+        e->valid |= extent_mask(first, ret);
+    }
+    ff_mutex_unlock(&sector_cache_lock);
+
+    blocks = FFMIN(blocks, ret);
+    memcpy(buf, dvd->sector_cache_buf, blocks * DVD_VIDEO_LB_LEN);
 
-    blocks = DVDReadBlocks(dvd->file, dvd->offset, 1, buf);
+    return blocks;
+}
+
+/* the readahead worker records skipped sectors while the demuxing thread publishes them */
+static void skip_lock(DVDContext *dvd)
+{
+#if HAVE_THREADS
+    if (dvd->ra_mutex_inited) {
+        pthread_mutex_lock(&dvd->ra_mutex);
+    }
+#endif
+}
 
-    dvd->offset++;
+static void skip_unlock(DVDContext *dvd)
+{
+#if HAVE_THREADS
+    if (dvd->ra_mutex_inited) {
+        pthread_mutex_unlock(&dvd->ra_mutex);
+    }
+#endif
+}
 
-    len = blocks * DVD_VIDEO_LB_LEN;
+static int skip_record(URLContext *h, uint32_t first, uint32_t last)
+{
+    DVDContext *dvd = h->priv_data;
+    uint32_t (*skipped)[2];
+    int ret = 0;
 
-    // TODO this isn't working for checking past offset, quitting at EOF
-    if (len == 0 || dvd->offset >= dvd->blocks) {
-        return AVERROR_EOF;
+    skip_lock(dvd);
+    /* consecutive skips of one bad area are a single range */
+    if (dvd->nb_skipped && dvd->skipped[dvd->nb_skipped - 1][1] + 1 == first) {
+        dvd->skipped[dvd->nb_skipped - 1][1] = last;
     } else {
-        return len;
+        skipped = av_realloc_array(dvd->skipped, dvd->nb_skipped + 1, sizeof(*dvd->skipped));
+        if (!skipped) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        dvd->skipped = skipped;
+        dvd->skipped[dvd->nb_skipped][0] = first;
+        dvd->skipped[dvd->nb_skipped][1] = last;
+        dvd->nb_skipped++;
+    }
+    dvd->bad_sectors += last - first + 1;
+end:
+    skip_unlock(dvd);
+    return ret;
+}
+
+/*
+ * Update the exported bad_sectors and skipped_ranges, only ever from the
+ * thread the caller reads them from, so av_opt_get() never sees a string
+ * being replaced.
+ */
+static int skip_publish(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+    AVBPrint bp;
+    int i;
+
+    skip_lock(dvd);
+    if (dvd->bad_sectors == dvd->stat_bad_sectors) {
+        skip_unlock(dvd);
+        return 0;
     }
+    dvd->stat_bad_sectors = dvd->bad_sectors;
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    for (i = 0; i < dvd->nb_skipped; i++) {
+        av_bprintf(&bp, "%s%u-%u", i ? " " : "", dvd->skipped[i][0], dvd->skipped[i][1]);
+    }
+    skip_unlock(dvd);
 
+    av_freep(&dvd->skipped_ranges);
+    return av_bprint_finalize(&bp, &dvd->skipped_ranges);
 }
 
-static int64_t dvd_seek(URLContext *h, int64_t pos, int whence)
+static int64_t range_size(const DVDRange *range)
+{
+    return ((int64_t)range->last_sector - range->first_sector + 1) * DVD_VIDEO_LB_LEN;
+}
+
+static void reorder_free(DVDContext *dvd, int range)
+{
+    if (dvd->reorder_buf[range]) {
+        av_freep(&dvd->reorder_buf[range]);
+        dvd->reorder_used -= range_size(&dvd->ranges[range]);
+    }
+}
+
+static int read_sectors(URLContext *h, int range, uint32_t sector, int blocks, uint8_t *buf, int *len);
+
+/* a seek, close or interrupt does not wait for the cells read ahead */
+static int reorder_abort(URLContext *h)
 {
+#if HAVE_THREADS
     DVDContext *dvd = h->priv_data;
 
-    if (!dvd || !dvd->dvd) {
-        return AVERROR(EFAULT);
+    if (atomic_load(&dvd->ra_abort)) {
+        return 1;
     }
-    av_log(h, AV_LOG_INFO, "seek position: %d\n", pos);
+#endif
+    return ff_check_interrupt(&h->interrupt_callback);
+}
 
-    /*
-    switch (whence) {
-    case SEEK_SET:
-    case SEEK_CUR:
-    case SEEK_END:
-        return -1;
+/*
+ * Called when a cell is entered from the disc: the cells played later that
+ * lie before it on the disc are read now, in ascending sector order, so
+ * none of them costs a backward seek when its turn comes. The first one
+ * that would take the buffered cells over reorder_size stops the lookahead,
+ * it and everything after it are read in playback order. Cells cut short
+ * by an abort are not kept.
+ */
+static int reorder_prefetch(URLContext *h, int range)
+{
+    DVDContext *dvd = h->priv_data;
+    int bulk = dvd->blocks_per_read ? dvd->blocks_per_read : DVD_BULK_BLOCKS;
+    int64_t used;
+    int nb = 0, i, j, len, ret = 0;
+
+    /* cells passed by a seek are not coming back */
+    for (i = 0; i < range; i++) {
+        reorder_free(dvd, i);
+    }
+
+    used = dvd->reorder_used;
+    for (i = range + 1; i < dvd->nb_ranges; i++) {
+        const DVDRange *r = &dvd->ranges[i];
+
+        if (dvd->reorder_buf[i] || r->first_sector >= dvd->ranges[range].first_sector) {
+            continue;
+        }
+        if (used + range_size(r) > dvd->reorder_size) {
+            av_log(h, AV_LOG_DEBUG, "cell %d does not fit in the reorder buffer, reading it in playback order\n", r->cell);
+            break;
+        }
+        used += range_size(r);
+        for (j = nb; j > 0 && dvd->ranges[dvd->reorder_list[j - 1]].first_sector > r->first_sector; j--) {
+            dvd->reorder_list[j] = dvd->reorder_list[j - 1];
+        }
+        dvd->reorder_list[j] = i;
+        nb++;
+    }
+
+    for (i = 0; i < nb; i++) {
+        const DVDRange *r = &dvd->ranges[dvd->reorder_list[i]];
+        uint32_t sector = r->first_sector;
+        uint8_t *data = av_malloc(range_size(r));
+
+        if (!data) {
+            return AVERROR(ENOMEM);
+        }
+        av_log(h, AV_LOG_DEBUG, "reading cell %d ahead of cell %d\n", r->cell, dvd->ranges[range].cell);
+        while (sector <= r->last_sector) {
+            if (reorder_abort(h)) {
+                av_free(data);
+                return AVERROR_EXIT;
+            }
+            ret = read_sectors(h, dvd->reorder_list[i], sector, FFMIN(bulk, r->last_sector - sector + 1),
+                               data + (size_t)(sector - r->first_sector) * DVD_VIDEO_LB_LEN, &len);
+            if (ret < 0 || len < ret) {
+                break;
+            }
+            sector += ret;
+        }
+        /* failed or dropped sectors are dealt with again in playback order */
+        if (sector <= r->last_sector) {
+            av_free(data);
+            dvd->skip_left = 0;
+            if (ret == AVERROR(ENOMEM)) {
+                return ret;
+            }
+            continue;
+        }
+        dvd->reorder_buf[dvd->reorder_list[i]] = data;
+        dvd->reorder_used += range_size(r);
+        dvd->stat_reordered++;
+    }
+
+    return 0;
+}
+
+/*
+ * Read up to blocks sectors, going around unreadable ones. Returns the
+ * number of sectors consumed; *len is set to how many of them were put
+ * in buf, which is less only when bad sectors are dropped.
+ */
+static int read_sectors(URLContext *h, int range, uint32_t sector, int blocks, uint8_t *buf, int *len)
+{
+    DVDContext *dvd = h->priv_data;
+    const DVDRange *r = &dvd->ranges[range];
+    uint32_t last = r->last_sector;
+    int i, ret;
+
+    if (dvd->reorder_buf) {
+        if (dvd->reorder_buf[range]) {
+            blocks = FFMIN(blocks, last - sector + 1);
+            memcpy(buf, dvd->reorder_buf[range] + (size_t)(sector - r->first_sector) * DVD_VIDEO_LB_LEN,
+                   (size_t)blocks * DVD_VIDEO_LB_LEN);
+            if (sector + blocks > last) {
+                reorder_free(dvd, range);
+            }
+            *len = blocks;
+            return blocks;
+        }
+        if (!dvd->reordering && sector == r->first_sector) {
+            dvd->reordering = 1;
+            ret = reorder_prefetch(h, range);
+            dvd->reordering = 0;
+            if (ret < 0) {
+                return ret;
+            }
+        }
+    }
+
+    if (!dvd->skip_left) {
+        if (dvd->sector_cache_disc >= 0) {
+            ret = sector_cache_read(h, range, sector, blocks, buf);
+        } else {
+            ret = read_blocks(h, range, sector, blocks, buf);
+        }
+        if (ret > 0) {
+            dvd->skip_size = dvd->skip_sectors;
+            *len = ret;
+            return ret;
+        }
+
+        /* the good sectors in front of the bad one are still wanted */
+        for (i = 0; i < blocks; i++) {
+            if (read_blocks(h, range, sector + i, 1, buf + (size_t)i * DVD_VIDEO_LB_LEN) != 1) {
+                break;
+            }
+        }
+        if (i > 0) {
+            dvd->skip_size = dvd->skip_sectors;
+            *len = i;
+            return i;
+        }
+
+        for (i = 0; i < dvd->retries; i++) {
+            av_usleep(FFMIN(dvd->retry_delay << i, 10000000));
+            dvd->stat_retries++;
+            if (read_blocks(h, range, sector, 1, buf) == 1) {
+                dvd->skip_size = dvd->skip_sectors;
+                *len = 1;
+                return 1;
+            }
+        }
+
+        if (dvd->bad_sector == DVD_BAD_SECTOR_FAIL) {
+            av_log(h, AV_LOG_ERROR, "cell %d: sector %u is unreadable\n", dvd->ranges[range].cell, sector);
+            return AVERROR(EIO);
+        }
+
+        /* skip ahead like ddrescue, further each time the next read fails too */
+        if (!dvd->skip_size) {
+            dvd->skip_size = dvd->skip_sectors;
+        }
+        dvd->skip_left = FFMIN(dvd->skip_size, last - sector + 1);
+        dvd->skip_size = FFMIN(dvd->skip_size, (1 << 20) / 2) * 2;
+        av_log(h, AV_LOG_WARNING, "cell %d: sector %u is unreadable, skipping sectors %u-%u\n",
+               dvd->ranges[range].cell, sector, sector, sector + dvd->skip_left - 1);
+        ret = skip_record(h, sector, sector + dvd->skip_left - 1);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    blocks = FFMIN(blocks, dvd->skip_left);
+    dvd->skip_left -= blocks;
+    if (dvd->bad_sector == DVD_BAD_SECTOR_ZERO) {
+        memset(buf, 0, (size_t)blocks * DVD_VIDEO_LB_LEN);
+        *len = blocks;
+    } else {
+        /* byte positions past here no longer match the read plan */
+        atomic_store(&dvd->dropped, 1);
+        *len = 0;
     }
-    */
 
-    av_log(h, AV_LOG_ERROR, "Unsupported whence operation %d\n", whence);
-    return AVERROR(EINVAL);
+    return blocks;
 }
 
+#if HAVE_THREADS
+static void *readahead_task(void *arg)
+{
+    URLContext *h = arg;
+    DVDContext *dvd = h->priv_data;
+    int range = dvd->cur_range;
+    uint32_t sector = dvd->sector;
+    int batch = dvd->blocks_per_read > 0 ? dvd->blocks_per_read : 16;
+    int ret = AVERROR_EOF;
+
+    while (range < dvd->nb_ranges && !atomic_load(&dvd->ra_abort)) {
+        unsigned head = atomic_load_explicit(&dvd->ra_head, memory_order_relaxed);
+        unsigned fill = head - atomic_load_explicit(&dvd->ra_tail, memory_order_acquire);
+        int blocks, len;
+
+        /* ring is full enough, sleep until the reader drains it to the low watermark */
+        if (fill >= dvd->readahead_high) {
+            pthread_mutex_lock(&dvd->ra_mutex);
+            while (!atomic_load(&dvd->ra_abort) &&
+                   head - atomic_load(&dvd->ra_tail) > dvd->readahead_low) {
+                pthread_cond_wait(&dvd->ra_cond_space, &dvd->ra_mutex);
+            }
+            pthread_mutex_unlock(&dvd->ra_mutex);
+            continue;
+        }
+
+        blocks = FFMIN(dvd->readahead_high - fill, dvd->readahead_size - head % dvd->readahead_size);
+        blocks = FFMIN(blocks, batch);
+        blocks = FFMIN(blocks, dvd->ranges[range].last_sector - sector + 1);
+
+        blocks = read_sectors(h, range, sector, blocks,
+                              dvd->ra_ring + (size_t)(head % dvd->readahead_size) * DVD_VIDEO_LB_LEN, &len);
+        if (blocks < 0) {
+            ret = blocks;
+            break;
+        }
+
+        sector += blocks;
+        if (sector > dvd->ranges[range].last_sector && ++range < dvd->nb_ranges) {
+            sector = dvd->ranges[range].first_sector;
+        }
+
+        if (!len) {
+            continue;
+        }
+        atomic_store_explicit(&dvd->ra_head, head + len, memory_order_release);
+        pthread_mutex_lock(&dvd->ra_mutex);
+        pthread_cond_signal(&dvd->ra_cond_data);
+        pthread_mutex_unlock(&dvd->ra_mutex);
+    }
+
+    pthread_mutex_lock(&dvd->ra_mutex);
+    dvd->ra_error = ret;
+    dvd->ra_done = 1;
+    pthread_cond_signal(&dvd->ra_cond_data);
+    pthread_mutex_unlock(&dvd->ra_mutex);
+
+    return NULL;
+}
+
+/* start filling the ring from the current cell and sector */
+static int readahead_start(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+    int ret;
+
+    atomic_store(&dvd->ra_head, 0);
+    atomic_store(&dvd->ra_tail, 0);
+    atomic_store(&dvd->ra_abort, 0);
+    dvd->ra_done = 0;
+
+    ret = pthread_create(&dvd->ra_thread, NULL, readahead_task, h);
+    if (ret != 0) {
+        av_log(h, AV_LOG_ERROR, "pthread_create failed : %s\n", av_err2str(AVERROR(ret)));
+        return AVERROR(ret);
+    }
+    dvd->ra_thread_started = 1;
+
+    return 0;
+}
+
+static void readahead_stop(DVDContext *dvd)
+{
+    if (!dvd->ra_thread_started) {
+        return;
+    }
+
+    pthread_mutex_lock(&dvd->ra_mutex);
+    atomic_store(&dvd->ra_abort, 1);
+    pthread_cond_signal(&dvd->ra_cond_space);
+    pthread_mutex_unlock(&dvd->ra_mutex);
+
+    pthread_join(dvd->ra_thread, NULL);
+    dvd->ra_thread_started = 0;
+}
+
+static int readahead_init(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+    int ret;
+
+    if (dvd->readahead_high == 0 || dvd->readahead_high > dvd->readahead_size) {
+        dvd->readahead_high = dvd->readahead_size;
+    }
+    if (dvd->readahead_low == 0) {
+        dvd->readahead_low = dvd->readahead_size / 4;
+    }
+    dvd->readahead_low = FFMIN(dvd->readahead_low, dvd->readahead_high - 1);
+
+    dvd->ra_ring = av_malloc_array(dvd->readahead_size, DVD_VIDEO_LB_LEN);
+    if (!dvd->ra_ring) {
+        return AVERROR(ENOMEM);
+    }
+
+    ret = pthread_mutex_init(&dvd->ra_mutex, NULL);
+    if (ret != 0) {
+        return AVERROR(ret);
+    }
+    ret = pthread_cond_init(&dvd->ra_cond_data, NULL);
+    if (ret != 0) {
+        pthread_mutex_destroy(&dvd->ra_mutex);
+        return AVERROR(ret);
+    }
+    ret = pthread_cond_init(&dvd->ra_cond_space, NULL);
+    if (ret != 0) {
+        pthread_cond_destroy(&dvd->ra_cond_data);
+        pthread_mutex_destroy(&dvd->ra_mutex);
+        return AVERROR(ret);
+    }
+    dvd->ra_mutex_inited = 1;
+
+    av_log(h, AV_LOG_DEBUG, "readahead ring of %d sectors, watermarks %d-%d\n",
+           dvd->readahead_size, dvd->readahead_low, dvd->readahead_high);
+
+    return readahead_start(h);
+}
+
+static int readahead_read(URLContext *h, unsigned char *buf, int size)
+{
+    DVDContext *dvd = h->priv_data;
+    unsigned tail = atomic_load_explicit(&dvd->ra_tail, memory_order_relaxed);
+    unsigned avail = atomic_load_explicit(&dvd->ra_head, memory_order_acquire) - tail;
+    int len = 0;
+
+    if (!avail) {
+        pthread_mutex_lock(&dvd->ra_mutex);
+        while (!(avail = atomic_load(&dvd->ra_head) - tail) && !dvd->ra_done) {
+            /* a drive can take seconds on one read, wake up to check the callback meanwhile */
+            int64_t t = av_gettime() + 100000;
+            struct timespec tv = { .tv_sec  =  t / 1000000,
+                                   .tv_nsec = (t % 1000000) * 1000 };
+
+            if (ff_check_interrupt(&h->interrupt_callback)) {
+                pthread_mutex_unlock(&dvd->ra_mutex);
+                return AVERROR_EXIT;
+            }
+            pthread_cond_timedwait(&dvd->ra_cond_data, &dvd->ra_mutex, &tv);
+        }
+        pthread_mutex_unlock(&dvd->ra_mutex);
+        if (!avail) {
+            return dvd->ra_error;
+        }
+    }
+
+    /* sector_skip is the number of bytes already consumed from the tail sector */
+    while (len < size && avail) {
+        const uint8_t *src = dvd->ra_ring + (size_t)(tail % dvd->readahead_size) * DVD_VIDEO_LB_LEN;
+        int n = FFMIN(size - len, DVD_VIDEO_LB_LEN - dvd->sector_skip);
+
+        memcpy(buf + len, src + dvd->sector_skip, n);
+        len += n;
+        dvd->sector_skip += n;
+        if (dvd->sector_skip == DVD_VIDEO_LB_LEN) {
+            dvd->sector_skip = 0;
+            dvd->offset++;
+            tail++;
+            avail--;
+        }
+    }
+
+    atomic_store_explicit(&dvd->ra_tail, tail, memory_order_release);
+    if (avail <= dvd->readahead_low) {
+        pthread_mutex_lock(&dvd->ra_mutex);
+        pthread_cond_signal(&dvd->ra_cond_space);
+        pthread_mutex_unlock(&dvd->ra_mutex);
+    }
+
+    return len;
+}
+#endif
+
+static void latency_log(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+    AVBPrint bp;
+    int i;
+
+    if (!dvd->stat_calls) {
+        return;
+    }
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_AUTOMATIC);
+    for (i = 0; i < DVD_LATENCY_BUCKETS; i++) {
+        if (!dvd->latency_hist[i]) {
+            continue;
+        }
+        if (i == DVD_LATENCY_BUCKETS - 1) {
+            av_bprintf(&bp, " >=%"PRId64"us:%"PRId64, INT64_C(1) << i, dvd->latency_hist[i]);
+        } else {
+            av_bprintf(&bp, " <%"PRId64"us:%"PRId64, INT64_C(2) << i, dvd->latency_hist[i]);
+        }
+    }
+    av_log(h, AV_LOG_INFO, "read latency:%s\n", bp.str);
+    av_bprint_finalize(&bp, NULL);
+}
+
+static int dvd_close(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+    int i;
+
+#if HAVE_THREADS
+    readahead_stop(dvd);
+    if (dvd->ra_mutex_inited) {
+        pthread_cond_destroy(&dvd->ra_cond_space);
+        pthread_cond_destroy(&dvd->ra_cond_data);
+        pthread_mutex_destroy(&dvd->ra_mutex);
+        dvd->ra_mutex_inited = 0;
+    }
+    av_freep(&dvd->ra_ring);
+#endif
+
+    trace_close(dvd);
+    sector_cache_leave(dvd);
+
+    if (dvd->file) {
+        skip_publish(h);
+        latency_log(h);
+        av_log(h, AV_LOG_INFO, "read %"PRId64" sectors in %"PRId64" calls (%"PRId64" short, %"PRId64" retried), "
+               "%"PRId64" ms in libdvdread, %"PRId64" cells, %"PRId64" bytes skipped\n",
+               dvd->stat_sectors, dvd->stat_calls, dvd->stat_short_reads, dvd->stat_retries,
+               dvd->stat_read_time / 1000, dvd->stat_cells, dvd->stat_bytes_skipped);
+        if (dvd->stat_bad_sectors) {
+            av_log(h, AV_LOG_WARNING, "%"PRId64" unreadable sectors skipped: %s\n",
+                   dvd->stat_bad_sectors, dvd->skipped_ranges);
+        }
+        disc_lock(dvd);
+        DVDCloseFile(dvd->file);
+        disc_unlock(dvd);
+        dvd->file = NULL;
+    }
+
+    if (dvd->vmg) {
+        close_ifo(dvd, dvd->vmg);
+        dvd->vmg = NULL;
+    }
+
+    if (dvd->vts) {
+        close_ifo(dvd, dvd->vts);
+        dvd->vts = NULL;
+    }
+
+    if (dvd->shared) {
+        disc_release(dvd);
+    } else if (dvd->dvd) {
+        DVDClose(dvd->dvd);
+        dvd->dvd = NULL;
+    }
+
+    if (dvd->reorder_buf) {
+        for (i = 0; i < dvd->nb_ranges; i++) {
+            av_free(dvd->reorder_buf[i]);
+        }
+        av_freep(&dvd->reorder_buf);
+    }
+    av_freep(&dvd->reorder_list);
+    av_freep(&dvd->ranges);
+    av_freep(&dvd->probe_buf);
+    dvd->probe_len = 0;
+    av_freep(&dvd->cell_score);
+    av_freep(&dvd->skipped);
+    dvd->nb_skipped = 0;
+
+    if (dvd->cache_buf) {
+        av_file_unmap(dvd->cache_buf, dvd->cache_size);
+        dvd->cache_buf = NULL;
+        dvd->titles = NULL;
+        dvd->cell_info = NULL;
+        dvd->chapter_cells = NULL;
+    } else {
+        av_freep(&dvd->titles);
+        av_freep(&dvd->cell_info);
+        av_freep(&dvd->chapter_cells);
+    }
+
+    return 0;
+}
+
+static uint32_t dvd_time_to_ms(const dvd_time_t *time)
+{
+#define BCD2INT(x) ((((x) >> 4) & 0xf) * 10 + ((x) & 0xf))
+    uint32_t ms = ((BCD2INT(time->hour) * 60 + BCD2INT(time->minute)) * 60 + BCD2INT(time->second)) * 1000;
+    int frames = BCD2INT(time->frame_u & 0x3f);
+
+    /* the two top bits of frame_u give the frame rate: 1 is 25 fps, 3 is 29.97 fps */
+    switch (time->frame_u >> 6) {
+    case 1:
+        ms += frames * 40;
+        break;
+    case 3:
+        ms += frames * 1001 / 30;
+        break;
+    }
+
+    return ms;
+#undef BCD2INT
+}
+
+/* add the program chains of a title and its chapters to the title map */
+static int parse_title(URLContext *h, const ifo_handle_t *vts, int title)
+{
+    DVDContext *dvd = h->priv_data;
+    DVDTitleInfo *info = &dvd->titles[title - 1];
+    const ttu_t *ttu;
+    const pgc_t *pgc;
+    DVDCellInfo *cell_info;
+    uint16_t *chapter_cells;
+    int *pgcns, *first_cells;
+    int nb_pgcs = 0, nb_cells = 0, nb_chapters;
+    uint32_t playback_time = 0;
+    int i, j, ret = 0;
+
+    if (info->vts_ttn < 1 || info->vts_ttn > vts->vts_ptt_srpt->nr_of_srpts) {
+        av_log(h, AV_LOG_ERROR, "Title %d has invalid TTN %d\n", title, info->vts_ttn);
+        return AVERROR_INVALIDDATA;
+    }
+    ttu = &vts->vts_ptt_srpt->title[info->vts_ttn - 1];
+    if (ttu->nr_of_ptts < 1 || ttu->ptt == NULL) {
+        av_log(h, AV_LOG_ERROR, "Program chain is broken\n");
+        return AVERROR_INVALIDDATA;
+    }
+
+    /* program chain numbers, then where their cells start in the title */
+    pgcns = av_malloc_array(ttu->nr_of_ptts, 2 * sizeof(*pgcns));
+    if (!pgcns) {
+        return AVERROR(ENOMEM);
+    }
+    first_cells = pgcns + ttu->nr_of_ptts;
+
+    /* the program chains in the order the PTTs reach them, or the one asked for when the title is a decoy */
+    if (dvd->pgc && title == dvd->title) {
+        if (dvd->pgc > vts->vts_pgcit->nr_of_pgci_srp) {
+            av_log(h, AV_LOG_ERROR, "Title set %d has no PGC %d\n", info->title_set, dvd->pgc);
+            ret = AVERROR(EINVAL);
+            goto end;
+        }
+        pgcns[nb_pgcs++] = dvd->pgc;
+    } else {
+        for (i = 0; i < ttu->nr_of_ptts; i++) {
+            int pgcn = ttu->ptt[i].pgcn;
+
+            if (pgcn < 1 || pgcn > vts->vts_pgcit->nr_of_pgci_srp) {
+                av_log(h, AV_LOG_ERROR, "Program chain is broken\n");
+                ret = AVERROR_INVALIDDATA;
+                goto end;
+            }
+            for (j = 0; j < nb_pgcs && pgcns[j] != pgcn; j++) {
+            }
+            if (j == nb_pgcs) {
+                pgcns[nb_pgcs++] = pgcn;
+            }
+        }
+    }
+
+    for (i = 0; i < nb_pgcs; i++) {
+        pgc = vts->vts_pgcit->pgci_srp[pgcns[i] - 1].pgc;
+        if (pgc == NULL || pgc->cell_playback == NULL || pgc->nr_of_cells < 1) {
+            av_log(h, AV_LOG_ERROR, "Program chain %d is empty\n", pgcns[i]);
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+        if (pgc->program_map == NULL || pgc->nr_of_programs < 1) {
+            av_log(h, AV_LOG_ERROR, "Program chain %d has no programs\n", pgcns[i]);
+            ret = AVERROR_INVALIDDATA;
+            goto end;
+        }
+        first_cells[i] = nb_cells;
+        nb_cells += pgc->nr_of_cells;
+    }
+    if (nb_cells > UINT16_MAX) {
+        av_log(h, AV_LOG_ERROR, "Title %d has too many cells\n", title);
+        ret = AVERROR_INVALIDDATA;
+        goto end;
+    }
+    if (nb_pgcs > 1) {
+        av_log(h, AV_LOG_VERBOSE, "title %d spans %d program chains\n", title, nb_pgcs);
+    }
+
+    /* a decoy chain has no PTTs of its own, its programs stand in for them */
+    pgc = vts->vts_pgcit->pgci_srp[pgcns[0] - 1].pgc;
+    nb_chapters = dvd->pgc && title == dvd->title ? pgc->nr_of_programs : ttu->nr_of_ptts;
+
+    /* on failure the tables stay as they were, the titles parsed so far point into them */
+    cell_info = av_realloc_array(dvd->cell_info, dvd->nb_cell_info + nb_cells, sizeof(*dvd->cell_info));
+    if (!cell_info) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    dvd->cell_info = cell_info;
+    chapter_cells = av_realloc_array(dvd->chapter_cells, dvd->nb_chapter_cells + nb_chapters,
+                                     sizeof(*dvd->chapter_cells));
+    if (!chapter_cells) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+    dvd->chapter_cells = chapter_cells;
+
+    if (dvd->pgc && title == dvd->title) {
+        for (i = 0; i < nb_chapters; i++) {
+            dvd->chapter_cells[dvd->nb_chapter_cells + i] = pgc->program_map[i];
+        }
+    } else {
+        for (i = 0; i < nb_chapters; i++) {
+            const ptt_info_t *ptt = &ttu->ptt[i];
+
+            for (j = 0; pgcns[j] != ptt->pgcn; j++) {
+            }
+            pgc = vts->vts_pgcit->pgci_srp[ptt->pgcn - 1].pgc;
+            if (ptt->pgn < 1 || ptt->pgn > pgc->nr_of_programs) {
+                av_log(h, AV_LOG_ERROR, "Chapter %d points to missing program %d of PGC %d\n",
+                       i + 1, ptt->pgn, ptt->pgcn);
+                ret = AVERROR_INVALIDDATA;
+                goto end;
+            }
+            dvd->chapter_cells[dvd->nb_chapter_cells + i] = first_cells[j] + pgc->program_map[ptt->pgn - 1];
+        }
+    }
+
+    info->pgcn = pgcns[0];
+    info->nr_of_pgcs = FFMIN(nb_pgcs, UINT8_MAX);
+    info->cell_idx = dvd->nb_cell_info;
+    info->nr_of_cells = nb_cells;
+    info->chapter_idx = dvd->nb_chapter_cells;
+    info->nr_of_chapters = nb_chapters;
+    dvd->nb_chapter_cells += nb_chapters;
+
+    for (i = 0; i < nb_pgcs; i++) {
+        pgc = vts->vts_pgcit->pgci_srp[pgcns[i] - 1].pgc;
+        playback_time += dvd_time_to_ms(&pgc->playback_time);
+        for (j = 0; j < pgc->nr_of_cells; j++) {
+            const cell_playback_t *cell = &pgc->cell_playback[j];
+            DVDCellInfo *ci = &dvd->cell_info[dvd->nb_cell_info++];
+
+            ci->first_sector = cell->first_sector;
+            ci->last_sector = cell->last_sector;
+            ci->playback_time = dvd_time_to_ms(&cell->playback_time);
+            ci->block_type = cell->block_type;
+            ci->block_mode = cell->block_mode;
+            ci->interleaved = cell->interleaved;
+            ci->reserved = 0;
+        }
+    }
+    info->playback_time = playback_time;
+
+end:
+    av_free(pgcns);
+    return ret;
+}
+
+static int open_vts(URLContext *h, int title_set, ifo_handle_t **vts)
+{
+    DVDContext *dvd = h->priv_data;
+
+    *vts = open_ifo(dvd, title_set);
+    if (*vts == NULL || (*vts)->vtsi_mat == NULL) {
+        av_log(h, AV_LOG_ERROR, "Opening video title set %d failed\n", title_set);
+        goto fail;
+    }
+
+    /* sanity checks on video title set */
+    if ((*vts)->vts_pgcit == NULL || (*vts)->vts_ptt_srpt == NULL || (*vts)->vts_ptt_srpt->title == NULL) {
+        av_log(h, AV_LOG_ERROR, "Video title set %d is empty\n", title_set);
+        goto fail;
+    }
+
+    return 0;
+fail:
+    if (*vts) {
+        close_ifo(dvd, *vts);
+        *vts = NULL;
+    }
+    return AVERROR(EIO);
+}
+
+/* the time and VOBU maps live in the title set IFO, which a cached open skips */
+static int load_vts(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+
+    if (dvd->vts) {
+        return 0;
+    }
+
+    return open_vts(h, dvd->title_set, &dvd->vts);
+}
+
+/*
+ * Fill in the program chains of the selected title, or of every title when
+ * all is set. The selected title set stays open in dvd->vts.
+ */
+static int parse_titles(URLContext *h, int all)
+{
+    DVDContext *dvd = h->priv_data;
+    int title_set, i, ret;
+
+    for (title_set = 1; title_set <= 99; title_set++) {
+        ifo_handle_t *vts = NULL;
+
+        if (title_set != dvd->title_set) {
+            if (!all) {
+                continue;
+            }
+            for (i = 0; i < dvd->nb_titles; i++) {
+                if (dvd->titles[i].title_set == title_set) {
+                    break;
+                }
+            }
+            if (i == dvd->nb_titles) {
+                continue;
+            }
+        }
+
+        /* other titles may be broken, but out of memory is out of memory */
+        ret = open_vts(h, title_set, &vts);
+        if (ret < 0) {
+            if (title_set == dvd->title_set || ret == AVERROR(ENOMEM)) {
+                return ret;
+            }
+            continue;
+        }
+
+        for (i = 0; i < dvd->nb_titles; i++) {
+            if (dvd->titles[i].title_set != title_set || (!all && i != dvd->title - 1)) {
+                continue;
+            }
+            ret = parse_title(h, vts, i + 1);
+            if (ret < 0 && (i == dvd->title - 1 || ret == AVERROR(ENOMEM))) {
+                close_ifo(dvd, vts);
+                return ret;
+            }
+        }
+
+        if (title_set == dvd->title_set) {
+            dvd->vts = vts;
+        } else {
+            close_ifo(dvd, vts);
+        }
+    }
+
+    return 0;
+}
+
+static int cmp_title_rank(const void *a, const void *b)
+{
+    const DVDTitleRank *ra = a, *rb = b;
+
+    if (ra->looping != rb->looping) {
+        return ra->looping - rb->looping;
+    }
+    if (ra->playback_time != rb->playback_time) {
+        return ra->playback_time < rb->playback_time ? 1 : -1;
+    }
+    if (ra->sectors != rb->sectors) {
+        return ra->sectors < rb->sectors ? 1 : -1;
+    }
+    if (ra->chapters != rb->chapters) {
+        return rb->chapters - ra->chapters;
+    }
+    return ra->title - rb->title;
+}
+
+/* sectors covered by the first angle of a title, each cell counted once */
+static uint32_t title_sectors(const DVDContext *dvd, const DVDTitleInfo *info)
+{
+    uint32_t sectors = 0;
+    int i, j;
+
+    for (i = 0; i < info->nr_of_cells; i++) {
+        const DVDCellInfo *cell = &dvd->cell_info[info->cell_idx + i];
+
+        if (cell->block_type == BLOCK_TYPE_ANGLE_BLOCK && cell->block_mode != BLOCK_MODE_FIRST_CELL) {
+            continue;
+        }
+        for (j = 0; j < i; j++) {
+            if (dvd->cell_info[info->cell_idx + j].first_sector == cell->first_sector) {
+                break;
+            }
+        }
+        if (j == i && cell->last_sector >= cell->first_sector) {
+            sectors += cell->last_sector - cell->first_sector + 1;
+        }
+    }
+
+    return sectors;
+}
+
+static int same_cells(const DVDContext *dvd, const DVDTitleInfo *a, const DVDTitleInfo *b)
+{
+    int i;
+
+    if (a->title_set != b->title_set || a->nr_of_cells != b->nr_of_cells) {
+        return 0;
+    }
+    for (i = 0; i < a->nr_of_cells; i++) {
+        const DVDCellInfo *ca = &dvd->cell_info[a->cell_idx + i];
+        const DVDCellInfo *cb = &dvd->cell_info[b->cell_idx + i];
+        if (ca->first_sector != cb->first_sector || ca->last_sector != cb->last_sector) {
+            return 0;
+        }
+    }
+
+    return 1;
+}
+
+/* below this average bit rate a title must be playing its cells over and over */
+#define DVD_MIN_FEATURE_RATE 1000000
+
+/*
+ * title=auto: rank the titles by playback time, then by the sectors they
+ * actually cover and then by chapters, from the title map alone. Titles
+ * playing the same cells as an earlier one are left out, titles looping
+ * over a few cells go last.
+ */
+static int select_main_title(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+    DVDTitleRank *rank;
+    AVBPrint bp;
+    int nb_rank = 0;
+    int i, j;
+
+    rank = av_malloc_array(dvd->nb_titles, sizeof(*rank));
+    if (!rank) {
+        return AVERROR(ENOMEM);
+    }
+
+    for (i = 0; i < dvd->nb_titles; i++) {
+        const DVDTitleInfo *info = &dvd->titles[i];
+        DVDTitleRank *r = &rank[nb_rank];
+
+        if (!info->nr_of_cells) {
+            continue;
+        }
+        for (j = 0; j < i; j++) {
+            if (same_cells(dvd, info, &dvd->titles[j])) {
+                break;
+            }
+        }
+        if (j < i) {
+            av_log(h, AV_LOG_DEBUG, "title %d plays the same cells as title %d\n", i + 1, j + 1);
+            continue;
+        }
+
+        r->title = i + 1;
+        r->playback_time = info->playback_time;
+        r->chapters = info->nr_of_chapters;
+        r->sectors = title_sectors(dvd, info);
+        r->looping = (uint64_t)r->sectors * DVD_VIDEO_LB_LEN * 8 * 1000 <
+                     (uint64_t)r->playback_time * DVD_MIN_FEATURE_RATE;
+        nb_rank++;
+    }
+
+    if (!nb_rank) {
+        av_free(rank);
+        av_log(h, AV_LOG_ERROR, "No title has a usable program chain\n");
+        return AVERROR(EIO);
+    }
+
+    qsort(rank, nb_rank, sizeof(*rank), cmp_title_rank);
+    dvd->title = rank[0].title;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    for (i = 0; i < nb_rank; i++) {
+        av_bprintf(&bp, "%s%d:%u:%u:%d", i ? " " : "", rank[i].title,
+                   rank[i].playback_time, rank[i].sectors, rank[i].chapters);
+    }
+    av_log(h, AV_LOG_INFO, "title %d is the main feature, %u ms, %u sectors, %d chapters\n",
+           rank[0].title, rank[0].playback_time, rank[0].sectors, rank[0].chapters);
+    av_free(rank);
+
+    av_freep(&dvd->title_ranking);
+    return av_bprint_finalize(&bp, &dvd->title_ranking);
+}
+
+static void lang_code_str(uint16_t code, char lang[3])
+{
+    lang[0] = code >> 8;
+    lang[1] = code & 0xff;
+    lang[2] = 0;
+    /* ISO 639 codes are stored lower case, anything else means no language */
+    if (lang[0] < 'a' || lang[0] > 'z' || lang[1] < 'a' || lang[1] > 'z') {
+        lang[0] = 0;
+    }
+}
+
+static const char *audio_format_name(int format)
+{
+    switch (format) {
+    case 0:  return "ac3";
+    case 2:
+    case 3:  return "mp2";
+    case 4:  return "pcm_dvd";
+    case 6:  return "dts";
+    default: return "unknown";
+    }
+}
+
+/* by video_attr_t.picture_size, the height is halved for the last one */
+static const int picture_widths[4] = { 720, 704, 352, 352 };
+
+/* stream ID the mpegps demuxer gives an audio stream, from its physical number */
+static int audio_stream_id(int format, int stream)
+{
+    switch (format) {
+    case 0:  return 0x80 + stream;
+    case 2:
+    case 3:  return 0x1c0 + stream;
+    case 4:  return 0xa0 + stream;
+    case 6:  return 0x88 + stream;
+    default: return -1;
+    }
+}
+
+/*
+ * ifo_streams: what a player knows about the title's streams before reading
+ * any of them. The PGC stream control tables say which streams exist and map
+ * them to the physical streams in the VOBs, whose IDs are what the mpegps
+ * demuxer uses as AVStream.id.
+ */
+static int describe_streams(URLContext *h, const DVDTitleInfo *info)
+{
+    DVDContext *dvd = h->priv_data;
+    const vtsi_mat_t *mat;
+    const video_attr_t *video;
+    const pgc_t *pgc;
+    AVBPrint bp;
+    char lang[3];
+    int pal, wide, i, ret;
+
+    ret = load_vts(h);
+    if (ret < 0) {
+        return ret;
+    }
+    if (info->pgcn < 1 || info->pgcn > dvd->vts->vts_pgcit->nr_of_pgci_srp ||
+        !(pgc = dvd->vts->vts_pgcit->pgci_srp[info->pgcn - 1].pgc)) {
+        return AVERROR_INVALIDDATA;
+    }
+    mat = dvd->vts->vtsi_mat;
+    video = &mat->vts_video_attr;
+    pal = video->video_format == 1;
+    wide = video->display_aspect_ratio == 3;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "[{\"id\":%d,\"type\":\"video\",\"codec\":\"%s\",\"width\":%d,\"height\":%d,"
+               "\"aspect\":\"%s\",\"frame_rate\":\"%s\"}",
+               0x1e0, video->mpeg_version ? "mpeg2video" : "mpeg1video",
+               picture_widths[video->picture_size],
+               (pal ? 576 : 480) >> (video->picture_size == 3), wide ? "16:9" : "4:3",
+               pal ? "25" : "30000/1001");
+
+    for (i = 0; i < FFMIN(mat->nr_of_vts_audio_streams, 8); i++) {
+        const audio_attr_t *audio = &mat->vts_audio_attr[i];
+        int id;
+
+        if (!(pgc->audio_control[i] & 0x8000)) {
+            continue;
+        }
+        id = audio_stream_id(audio->audio_format, (pgc->audio_control[i] >> 8) & 7);
+        if (id < 0) {
+            av_log(h, AV_LOG_WARNING, "audio stream %d has unknown format %d\n", i + 1, audio->audio_format);
+            continue;
+        }
+        lang_code_str(audio->lang_type == 1 ? audio->lang_code : 0, lang);
+        av_bprintf(&bp, ",{\"id\":%d,\"type\":\"audio\",\"codec\":\"%s\",\"channels\":%d,"
+                   "\"sample_rate\":%d,\"language\":\"%s\"}",
+                   id, audio_format_name(audio->audio_format), audio->channels + 1,
+                   audio->sample_frequency ? 96000 : 48000, lang);
+    }
+
+    for (i = 0; i < FFMIN(mat->nr_of_vts_subp_streams, 32); i++) {
+        uint32_t control = pgc->subp_control[i];
+        int j;
+
+        if (!(control & 0x80000000)) {
+            continue;
+        }
+        lang_code_str(mat->vts_subp_attr[i].lang_code, lang);
+        /* widescreen titles carry a separate subpicture for the wide picture */
+        av_bprintf(&bp, ",{\"id\":%d,\"type\":\"subtitle\",\"codec\":\"dvd_subtitle\",\"language\":\"%s\",\"palette\":\"",
+                   0x20 + ((control >> (wide ? 16 : 24)) & 0x1f), lang);
+        /* the PGC palette is Y Cr Cb, the decoder wants RGB */
+        for (j = 0; j < 16; j++) {
+            int y = (pgc->palette[j] >> 16) & 0xff, cr = (pgc->palette[j] >> 8) & 0xff, cb = pgc->palette[j] & 0xff;
+            av_bprintf(&bp, "%s%02x%02x%02x", j ? "," : "",
+                       av_clip_uint8(y + ((91881 * (cr - 128) + 32768) >> 16)),
+                       av_clip_uint8(y + ((-22554 * (cb - 128) - 46802 * (cr - 128) + 32768) >> 16)),
+                       av_clip_uint8(y + ((116130 * (cb - 128) + 32768) >> 16)));
+        }
+        av_bprintf(&bp, "\"}");
+    }
+    av_bprintf(&bp, "]");
+
+    av_freep(&dvd->streams);
+    return av_bprint_finalize(&bp, &dvd->streams);
+}
+
+/*
+ * list_titles: describe every title as JSON from the VMG and title set IFOs,
+ * without opening any VOB.
+ */
+static int list_titles(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+    AVBPrint bp;
+    char lang[3];
+    int title_set, i, j, ret;
+    int first = 1;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, "[");
+    for (title_set = 1; title_set <= 99; title_set++) {
+        ifo_handle_t *vts = NULL;
+        const video_attr_t *video;
+        const vtsi_mat_t *mat;
+        int pal;
+
+        for (i = 0; i < dvd->nb_titles; i++) {
+            if (dvd->titles[i].title_set == title_set) {
+                break;
+            }
+        }
+        if (i == dvd->nb_titles || open_vts(h, title_set, &vts) < 0) {
+            continue;
+        }
+        mat = vts->vtsi_mat;
+        video = &mat->vts_video_attr;
+        pal = video->video_format == 1;
+
+        for (i = 0; i < dvd->nb_titles; i++) {
+            const DVDTitleInfo *info = &dvd->titles[i];
+
+            if (info->title_set != title_set) {
+                continue;
+            }
+            if (!info->nr_of_cells && !dvd->cache_buf) {
+                ret = parse_title(h, vts, i + 1);
+                if (ret == AVERROR(ENOMEM)) {
+                    close_ifo(dvd, vts);
+                    av_bprint_finalize(&bp, NULL);
+                    return ret;
+                }
+                if (ret < 0) {
+                    continue;
+                }
+            }
+
+            av_bprintf(&bp, "%s{\"title\":%d,\"title_set\":%d,\"ttn\":%d,\"pgcn\":%d,"
+                       "\"duration_ms\":%u,\"chapters\":%d,\"cells\":%d,\"angles\":%d,\"sectors\":%u,",
+                       first ? "" : ",", i + 1, title_set, info->vts_ttn, info->pgcn,
+                       info->playback_time, info->nr_of_chapters, info->nr_of_cells, info->nr_of_angles,
+                       title_sectors(dvd, info));
+            av_bprintf(&bp, "\"video\":{\"codec\":\"%s\",\"standard\":\"%s\",\"width\":%d,\"height\":%d,\"aspect\":\"%s\"},",
+                       video->mpeg_version ? "mpeg2video" : "mpeg1video", pal ? "pal" : "ntsc",
+                       picture_widths[video->picture_size], (pal ? 576 : 480) >> (video->picture_size == 3),
+                       video->display_aspect_ratio == 3 ? "16:9" : "4:3");
+
+            av_bprintf(&bp, "\"audio\":[");
+            for (j = 0; j < FFMIN(mat->nr_of_vts_audio_streams, 8); j++) {
+                const audio_attr_t *audio = &mat->vts_audio_attr[j];
+
+                lang_code_str(audio->lang_type == 1 ? audio->lang_code : 0, lang);
+                av_bprintf(&bp, "%s{\"codec\":\"%s\",\"channels\":%d,\"sample_rate\":%d,\"language\":\"%s\"}",
+                           j ? "," : "", audio_format_name(audio->audio_format), audio->channels + 1,
+                           audio->sample_frequency ? 96000 : 48000, lang);
+            }
+            av_bprintf(&bp, "],\"subpictures\":[");
+            for (j = 0; j < FFMIN(mat->nr_of_vts_subp_streams, 32); j++) {
+                lang_code_str(mat->vts_subp_attr[j].lang_code, lang);
+                av_bprintf(&bp, "%s{\"language\":\"%s\"}", j ? "," : "", lang);
+            }
+            av_bprintf(&bp, "]}");
+            first = 0;
+        }
+
+        close_ifo(dvd, vts);
+    }
+    av_bprintf(&bp, "]");
+
+    av_freep(&dvd->title_list);
+    return av_bprint_finalize(&bp, &dvd->title_list);
+}
+
+static char *ifo_cache_path(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+
+    if (!dvd->disc_id[0]) {
+        av_log(h, AV_LOG_WARNING, "DVDDiscID() failed, not using the IFO cache\n");
+        return NULL;
+    }
+
+    return av_asprintf("%s/%s.ifomap", dvd->ifo_cache_dir, dvd->disc_id);
+}
+
+/* returns 1 if the title map was loaded from the cache */
+static int ifo_cache_load(URLContext *h, const char *path)
+{
+    DVDContext *dvd = h->priv_data;
+    const DVDCacheHeader *hdr;
+    uint8_t *buf;
+    size_t size;
+    int i;
+
+    if (avio_check(path, AVIO_FLAG_READ) <= 0) {
+        return 0;
+    }
+    if (av_file_map(path, &buf, &size, 0, h) < 0) {
+        return 0;
+    }
+
+    hdr = (const DVDCacheHeader *)buf;
+    if (size < sizeof(*hdr) || hdr->magic != DVD_CACHE_MAGIC || hdr->version != DVD_CACHE_VERSION ||
+        hdr->nb_titles < 1 || hdr->nb_titles > 99 || hdr->nb_cells > INT_MAX / sizeof(DVDCellInfo) ||
+        hdr->nb_chapters > INT_MAX / sizeof(*dvd->chapter_cells) ||
+        size != sizeof(*hdr) + hdr->nb_titles * sizeof(DVDTitleInfo) +
+                hdr->nb_cells * sizeof(DVDCellInfo) + hdr->nb_chapters * sizeof(*dvd->chapter_cells)) {
+        goto invalid;
+    }
+
+    dvd->titles = (DVDTitleInfo *)(buf + sizeof(*hdr));
+    dvd->nb_titles = hdr->nb_titles;
+    dvd->cell_info = (DVDCellInfo *)(dvd->titles + dvd->nb_titles);
+    dvd->nb_cell_info = hdr->nb_cells;
+    dvd->chapter_cells = (uint16_t *)(dvd->cell_info + dvd->nb_cell_info);
+    dvd->nb_chapter_cells = hdr->nb_chapters;
+
+    for (i = 0; i < dvd->nb_titles; i++) {
+        const DVDTitleInfo *info = &dvd->titles[i];
+        if (info->title_set < 1 || info->title_set > 99 ||
+            (uint64_t)info->cell_idx + info->nr_of_cells > dvd->nb_cell_info ||
+            (uint64_t)info->chapter_idx + info->nr_of_chapters > dvd->nb_chapter_cells) {
+            goto invalid;
+        }
+        /*
+         * a title that failed to parse when the file was written may parse now,
+         * read the IFOs again if this open needs it
+         */
+        if (!info->nr_of_cells && (i == dvd->title - 1 || dvd->title == 0 || dvd->extract_titles)) {
+            av_log(h, AV_LOG_VERBOSE, "title %d is empty in IFO cache file %s, reading the IFOs\n", i + 1, path);
+            goto stale;
+        }
+    }
+
+    dvd->cache_buf = buf;
+    dvd->cache_size = size;
+    av_log(h, AV_LOG_DEBUG, "title map loaded from %s\n", path);
+
+    return 1;
+invalid:
+    av_log(h, AV_LOG_WARNING, "ignoring invalid IFO cache file %s\n", path);
+stale:
+    dvd->titles = NULL;
+    dvd->cell_info = NULL;
+    dvd->chapter_cells = NULL;
+    dvd->nb_titles = dvd->nb_cell_info = dvd->nb_chapter_cells = 0;
+    av_file_unmap(buf, size);
+    return 0;
+}
+
+static void ifo_cache_store(URLContext *h, const char *path)
+{
+    DVDContext *dvd = h->priv_data;
+    DVDCacheHeader hdr = { 0 };
+    URLContext *out = NULL;
+    char *tmp;
+    int ret;
+
+    hdr.magic = DVD_CACHE_MAGIC;
+    hdr.version = DVD_CACHE_VERSION;
+    disc_lock(dvd);
+    ret = DVDDiscID(dvd->dvd, hdr.disc_id);
+    disc_unlock(dvd);
+    if (ret < 0) {
+        return;
+    }
+    hdr.nb_titles = dvd->nb_titles;
+    hdr.nb_cells = dvd->nb_cell_info;
+    hdr.nb_chapters = dvd->nb_chapter_cells;
+
+    /* write to a private file first so concurrent opens never map a partial one */
+    tmp = av_asprintf("%s.%08x.tmp", path, av_get_random_seed());
+    if (!tmp) {
+        return;
+    }
+
+    ret = ffurl_open_whitelist(&out, tmp, AVIO_FLAG_WRITE, &h->interrupt_callback, NULL,
+                               h->protocol_whitelist, h->protocol_blacklist, h);
+    if (ret >= 0) {
+        ret = ffurl_write(out, (const unsigned char *)&hdr, sizeof(hdr));
+    }
+    if (ret >= 0) {
+        ret = ffurl_write(out, (const unsigned char *)dvd->titles, dvd->nb_titles * sizeof(*dvd->titles));
+    }
+    if (ret >= 0 && dvd->nb_cell_info) {
+        ret = ffurl_write(out, (const unsigned char *)dvd->cell_info, dvd->nb_cell_info * sizeof(*dvd->cell_info));
+    }
+    if (ret >= 0 && dvd->nb_chapter_cells) {
+        ret = ffurl_write(out, (const unsigned char *)dvd->chapter_cells, dvd->nb_chapter_cells * sizeof(*dvd->chapter_cells));
+    }
+    ffurl_closep(&out);
+
+    if (ret >= 0) {
+        ret = ff_rename(tmp, path, h);
+    }
+    if (ret < 0) {
+        av_log(h, AV_LOG_WARNING, "could not write IFO cache file %s: %s\n", path, av_err2str(ret));
+        avpriv_io_delete(tmp);
+    } else {
+        av_log(h, AV_LOG_DEBUG, "title map written to %s\n", path);
+    }
+    av_free(tmp);
+}
+
+/* highest DVD-Video mux rate, in bits per second */
+#define DVD_MAX_MUX_RATE 10080000
+
+/*
+ * Structure protection fills a title set with decoy titles whose cells
+ * point at junk or deliberately unreadable sectors. Give every cell of the
+ * title a point for each sign of that, with build_ranges() leaving out the
+ * cells that score cell_filter or more.
+ */
+static int score_cells(URLContext *h, const DVDTitleInfo *info)
+{
+    DVDContext *dvd = h->priv_data;
+    AVBPrint bp;
+    int i, j, k;
+
+    dvd->cell_score = av_mallocz(info->nr_of_cells);
+    if (!dvd->cell_score) {
+        return AVERROR(ENOMEM);
+    }
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    for (i = 0; i < info->nr_of_cells; i++) {
+        const DVDCellInfo *cell = &dvd->cell_info[info->cell_idx + i];
+        uint64_t bits = ((uint64_t)cell->last_sector - cell->first_sector + 1) * DVD_VIDEO_LB_LEN * 8;
+        int shared = 0, overlaps = 0;
+        int score = 0;
+
+        /* a cell with no playback time at all counts as short twice */
+        if (cell->playback_time < 1000) {
+            score++;
+        }
+        if (cell->playback_time == 0) {
+            score++;
+        }
+        /* more data than a player could get through in the cell's playback time */
+        if (cell->playback_time && bits * 1000 / cell->playback_time > DVD_MAX_MUX_RATE + DVD_MAX_MUX_RATE / 4) {
+            score += 2;
+        }
+
+        for (j = 0; j < dvd->nb_titles; j++) {
+            const DVDTitleInfo *other = &dvd->titles[j];
+            int uses = 0;
+
+            if (other->title_set != info->title_set) {
+                continue;
+            }
+            for (k = 0; k < other->nr_of_cells; k++) {
+                const DVDCellInfo *oc = &dvd->cell_info[other->cell_idx + k];
+
+                if (oc->first_sector == cell->first_sector && oc->last_sector == cell->last_sector) {
+                    uses = 1;
+                } else if (oc->first_sector <= cell->last_sector && oc->last_sector >= cell->first_sector &&
+                           oc->block_type != BLOCK_TYPE_ANGLE_BLOCK && cell->block_type != BLOCK_TYPE_ANGLE_BLOCK) {
+                    /* cells normally share sectors whole, interleaved angles aside */
+                    overlaps = 1;
+                }
+            }
+            shared += uses;
+        }
+        if (shared > 4) {
+            score++;
+        }
+        if (overlaps) {
+            score++;
+        }
+
+        dvd->cell_score[i] = score;
+        av_log(h, AV_LOG_DEBUG, "cell %d: %u ms, %u sectors, in %d titles%s, score %d\n",
+               i + 1, cell->playback_time, cell->last_sector - cell->first_sector + 1, shared,
+               overlaps ? ", overlapping" : "", score);
+        if (score >= dvd->cell_filter) {
+            av_bprintf(&bp, "%s%d:%d", bp.len ? " " : "", i + 1, score);
+        }
+    }
+
+    av_freep(&dvd->filtered_cells);
+    return av_bprint_finalize(&bp, &dvd->filtered_cells);
+}
+
+static int build_ranges(URLContext *h, const DVDTitleInfo *info, int first_cell, int last_cell)
+{
+    DVDContext *dvd = h->priv_data;
+    ssize_t vob_blocks = DVDFileSize(dvd->file);
+    uint32_t time = 0;
+    int i;
+
+    if (vob_blocks < 0) {
+        av_log(h, AV_LOG_ERROR, "DVDFileSize() failed\n");
+        return AVERROR(EIO);
+    }
+
+    dvd->ranges = av_malloc_array(last_cell - first_cell + 1, sizeof(*dvd->ranges));
+    if (!dvd->ranges) {
+        return AVERROR(ENOMEM);
+    }
+
+    dvd->nb_ranges = 0;
+    dvd->blocks = 0;
+    for (i = 0; i < last_cell; i++) {
+        const DVDCellInfo *cell = &dvd->cell_info[info->cell_idx + i];
+        DVDRange *range;
+
+        /* only follow the first angle of an angle block */
+        if (cell->block_type == BLOCK_TYPE_ANGLE_BLOCK && cell->block_mode != BLOCK_MODE_FIRST_CELL) {
+            continue;
+        }
+
+        time += cell->playback_time;
+        if (i < first_cell - 1) {
+            dvd->start_time = time;
+            continue;
+        }
+
+        if (cell->first_sector > cell->last_sector || cell->last_sector >= vob_blocks) {
+            av_log(h, AV_LOG_WARNING, "skipping cell %d with invalid sectors %u-%u\n",
+                   i + 1, cell->first_sector, cell->last_sector);
+            continue;
+        }
+        if (dvd->cell_score && dvd->cell_score[i] >= dvd->cell_filter) {
+            av_log(h, AV_LOG_WARNING, "skipping suspicious cell %d, sectors %u-%u, score %d\n",
+                   i + 1, cell->first_sector, cell->last_sector, dvd->cell_score[i]);
+            continue;
+        }
+        /*
+         * An interleaved cell's sectors also hold the ILVUs of the other
+         * angles or paths; telling them apart takes the DSI packets, so the
+         * cell is read whole.
+         */
+        if (cell->interleaved) {
+            av_log(h, AV_LOG_WARNING, "cell %d is interleaved, its sectors %u-%u are read as is and may mix angles\n",
+                   i + 1, cell->first_sector, cell->last_sector);
+        }
+
+        range = &dvd->ranges[dvd->nb_ranges++];
+        range->cell = i + 1;
+        range->first_sector = cell->first_sector;
+        range->last_sector = cell->last_sector;
+        range->pos = dvd->blocks * DVD_VIDEO_LB_LEN;
+        range->time = time - cell->playback_time;
+        range->duration = cell->playback_time;
+        dvd->blocks += range->last_sector - range->first_sector + 1;
+
+        av_log(h, AV_LOG_DEBUG, "cell %d: sectors %u-%u\n", range->cell, range->first_sector, range->last_sector);
+    }
+
+    if (dvd->nb_ranges == 0) {
+        av_log(h, AV_LOG_ERROR, "Title has no readable cells\n");
+        return AVERROR(EIO);
+    }
+
+    return 0;
+}
+
+/*
+ * Chapter times from the PTT entry cells and the cell playback times, relative
+ * to the start of the selection, in the form ffmpeg reads with
+ * -map_chapters from a metadata input.
+ */
+static int build_chapters(URLContext *h, const DVDTitleInfo *info)
+{
+    DVDContext *dvd = h->priv_data;
+    uint32_t *cell_time;
+    AVBPrint bp;
+    int i;
+
+    /* start time of every cell, plus the end of the title */
+    cell_time = av_malloc_array(info->nr_of_cells + 1, sizeof(*cell_time));
+    if (!cell_time) {
+        return AVERROR(ENOMEM);
+    }
+    cell_time[0] = 0;
+    for (i = 0; i < info->nr_of_cells; i++) {
+        const DVDCellInfo *cell = &dvd->cell_info[info->cell_idx + i];
+
+        cell_time[i + 1] = cell_time[i];
+        if (cell->block_type != BLOCK_TYPE_ANGLE_BLOCK || cell->block_mode == BLOCK_MODE_FIRST_CELL) {
+            cell_time[i + 1] += cell->playback_time;
+        }
+    }
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    av_bprintf(&bp, ";FFMETADATA1\n");
+    for (i = dvd->chapter_start; i <= dvd->chapter_end; i++) {
+        int first = dvd->chapter_cells[info->chapter_idx + i - 1];
+        int next = i < dvd->chapters ? dvd->chapter_cells[info->chapter_idx + i] : info->nr_of_cells + 1;
+        uint32_t start, end;
+
+        if (first < 1 || next > info->nr_of_cells + 1 || first > next) {
+            av_log(h, AV_LOG_WARNING, "Chapter map is broken, no chapters after chapter %d\n", i - 1);
+            break;
+        }
+        start = cell_time[first - 1];
+        end = cell_time[next - 1];
+
+        av_bprintf(&bp, "[CHAPTER]\nTIMEBASE=1/1000\nSTART=%u\nEND=%u\ntitle=Chapter %d\n",
+                   start - dvd->start_time, end - dvd->start_time, i);
+    }
+    av_free(cell_time);
+
+    av_freep(&dvd->chapter_list);
+    return av_bprint_finalize(&bp, &dvd->chapter_list);
+}
+
+/*
+ * Every VOBU starts with a NAV pack followed by an I-frame, so the VOBU
+ * address map is a keyframe index. Timestamps are interpolated inside
+ * each cell from its playback time.
+ */
+static int build_keyframe_index(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+    const vobu_admap_t *admap;
+    AVBPrint bp;
+    int nb_vobus, nb_entries = 0;
+    int i, ret;
+
+    ret = load_vts(h);
+    if (ret < 0) {
+        return ret;
+    }
+    admap = dvd->vts->vts_vobu_admap;
+    if (!admap || !admap->vobu_start_sectors || admap->last_byte < VOBU_ADMAP_SIZE) {
+        av_log(h, AV_LOG_WARNING, "title set has no VOBU address map\n");
+        return 0;
+    }
+    nb_vobus = (admap->last_byte + 1 - VOBU_ADMAP_SIZE) / 4;
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    for (i = 0; i < dvd->nb_ranges; i++) {
+        const DVDRange *range = &dvd->ranges[i];
+        uint32_t sectors = range->last_sector - range->first_sector + 1;
+        int lo = 0, hi = nb_vobus;
+
+        /* first VOBU of the cell */
+        while (lo < hi) {
+            int mid = (lo + hi) / 2;
+            if (admap->vobu_start_sectors[mid] < range->first_sector) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+
+        for (; lo < nb_vobus && admap->vobu_start_sectors[lo] <= range->last_sector; lo++) {
+            uint32_t sector = admap->vobu_start_sectors[lo];
+            int64_t pos = range->pos + (int64_t)(sector - range->first_sector) * DVD_VIDEO_LB_LEN;
+            int64_t time = range->time - dvd->start_time +
+                           (int64_t)range->duration * (sector - range->first_sector) / sectors;
+
+            av_bprintf(&bp, "%s%"PRId64":%"PRId64, nb_entries++ ? " " : "", pos, time * 1000);
+        }
+    }
+
+    if (!av_bprint_is_complete(&bp)) {
+        av_bprint_finalize(&bp, NULL);
+        return AVERROR(ENOMEM);
+    }
+    av_freep(&dvd->keyframe_index);
+    ret = av_bprint_finalize(&bp, &dvd->keyframe_index);
+    if (ret < 0) {
+        return ret;
+    }
+
+    av_log(h, AV_LOG_DEBUG, "keyframe index has %d entries\n", nb_entries);
+
+    return 0;
+}
+
+static int select_extract_titles(URLContext *h, uint8_t *selected)
+{
+    DVDContext *dvd = h->priv_data;
+    const char *p = dvd->extract_titles;
+    char *end;
+    long title;
+    int i, j;
+
+    if (!strcmp(p, "all")) {
+        for (i = 0; i < dvd->nb_titles; i++) {
+            if (!dvd->titles[i].nr_of_cells) {
+                av_log(h, AV_LOG_WARNING, "title %d has no program chain, not extracting it\n", i + 1);
+                continue;
+            }
+            for (j = 0; j < i; j++) {
+                if (selected[j] && same_cells(dvd, &dvd->titles[j], &dvd->titles[i])) {
+                    break;
+                }
+            }
+            if (j < i) {
+                av_log(h, AV_LOG_VERBOSE, "title %d plays the same cells as title %d, not extracting it\n", i + 1, j + 1);
+                continue;
+            }
+            selected[i] = 1;
+        }
+        return 0;
+    }
+
+    while (*p) {
+        title = strtol(p, &end, 10);
+        if (end == p || (*end && *end != ',') || title < 1 || title > dvd->nb_titles) {
+            av_log(h, AV_LOG_ERROR, "invalid title list %s, disc has %d titles\n", dvd->extract_titles, dvd->nb_titles);
+            return AVERROR(EINVAL);
+        }
+        selected[title - 1] = 1;
+        p = *end ? end + 1 : end;
+    }
+
+    return 0;
+}
+
+static int cmp_extract_piece(const void *a, const void *b)
+{
+    const DVDExtractPiece *pa = a, *pb = b;
+
+    if (pa->first_sector != pb->first_sector) {
+        return pa->first_sector < pb->first_sector ? -1 : 1;
+    }
+    return pa->output - pb->output;
+}
+
+static int extract_write(URLContext *h, DVDExtractOutput *out, int64_t pos, const uint8_t *buf, int size)
+{
+    int64_t ret;
+
+    if (out->pos != pos) {
+        ret = ffurl_seek(out->url, pos, SEEK_SET);
+        if (ret < 0) {
+            av_log(h, AV_LOG_ERROR, "title %d plays its cells out of disc order and its output cannot seek\n", out->title);
+            return ret;
+        }
+    }
+    ret = ffurl_write(out->url, buf, size);
+    if (ret < 0) {
+        av_log(h, AV_LOG_ERROR, "could not write title %d: %s\n", out->title, av_err2str(ret));
+        return ret;
+    }
+    out->pos = pos + size;
+
+    return 0;
+}
+
+/*
+ * extract_titles: write every selected title to its own output in a single
+ * pass. Each title set is read once in ascending sector order over the union
+ * of the cells its titles play, and every sector read is written to each
+ * title playing it, at that title's offset. Outputs must be seekable unless
+ * the title plays its cells in disc order.
+ */
+static int extract_titles(URLContext *h)
+{
+    DVDContext *dvd = h->priv_data;
+    DVDExtractOutput *outputs = NULL;
+    DVDExtractPiece *pieces = NULL, *tmp;
+    uint8_t *selected = NULL, *buf = NULL;
+    char filename[1024];
+    int nb_outputs = 0, nb_pieces, blocks_per_read;
+    int64_t played = 0, unique = 0;
+    int title_set, i, j, k, len, ret;
+    AVBPrint bp;
+
+    if (!dvd->extract_output || av_get_frame_filename(filename, sizeof(filename), dvd->extract_output, 1) < 0) {
+        av_log(h, AV_LOG_ERROR, "extract_titles needs an extract_output with %%d for the title number\n");
+        return AVERROR(EINVAL);
+    }
+
+    /* the outputs are written at fixed offsets, a dropped sector would shift the rest */
+    if (dvd->bad_sector == DVD_BAD_SECTOR_DROP) {
+        av_log(h, AV_LOG_WARNING, "unreadable sectors are zeroed when extracting, not dropped\n");
+        dvd->bad_sector = DVD_BAD_SECTOR_ZERO;
+    }
+
+    blocks_per_read = dvd->blocks_per_read ? dvd->blocks_per_read : DVD_BULK_BLOCKS;
+    selected = av_mallocz(dvd->nb_titles);
+    outputs = av_mallocz_array(dvd->nb_titles, sizeof(*outputs));
+    buf = av_malloc((size_t)blocks_per_read * DVD_VIDEO_LB_LEN);
+    if (!selected || !outputs || !buf) {
+        ret = AVERROR(ENOMEM);
+        goto end;
+    }
+
+    ret = select_extract_titles(h, selected);
+    if (ret < 0) {
+        goto end;
+    }
+
+    /* title sets follow each other on the disc in order */
+    for (title_set = 1; title_set <= 99; title_set++) {
+        for (i = 0; i < dvd->nb_titles; i++) {
+            if (selected[i] && dvd->titles[i].title_set == title_set) {
+                break;
+            }
+        }
+        if (i == dvd->nb_titles) {
+            continue;
+        }
+
+        if (dvd->file) {
+            disc_lock(dvd);
+            DVDCloseFile(dvd->file);
+            disc_unlock(dvd);
+        }
+        disc_lock(dvd);
+        dvd->file = DVDOpenFile(dvd->dvd, title_set, DVD_READ_TITLE_VOBS);
+        disc_unlock(dvd);
+        if (!dvd->file) {
+            av_log(h, AV_LOG_ERROR, "DVDOpenFile() failed for title set %d\n", title_set);
+            ret = AVERROR(EIO);
+            goto end;
+        }
+        dvd->title_set = title_set;
+
+        /* where each played cell goes in its title's output */
+        nb_pieces = 0;
+        for (; i < dvd->nb_titles; i++) {
+            const DVDTitleInfo *info = &dvd->titles[i];
+            DVDExtractOutput *out = &outputs[nb_outputs];
+
+            if (!selected[i] || info->title_set != title_set) {
+                continue;
+            }
+
+            dvd->title = i + 1;
+            av_freep(&dvd->cell_score);
+            if (dvd->cell_filter) {
+                ret = score_cells(h, info);
+                if (ret < 0) {
+                    goto end;
+                }
+            }
+            av_freep(&dvd->ranges);
+            ret = build_ranges(h, info, 1, info->nr_of_cells);
+            if (ret == AVERROR(EIO)) {
+                av_log(h, AV_LOG_WARNING, "title %d has nothing to extract\n", i + 1);
+                continue;
+            }
+            if (ret < 0) {
+                goto end;
+            }
+
+            tmp = av_realloc_array(pieces, nb_pieces + dvd->nb_ranges, sizeof(*pieces));
+            if (!tmp) {
+                ret = AVERROR(ENOMEM);
+                goto end;
+            }
+            pieces = tmp;
+            for (j = 0; j < dvd->nb_ranges; j++) {
+                DVDExtractPiece *piece = &pieces[nb_pieces++];
+                piece->output = nb_outputs;
+                piece->cell = dvd->ranges[j].cell;
+                piece->first_sector = dvd->ranges[j].first_sector;
+                piece->last_sector = dvd->ranges[j].last_sector;
+                piece->pos = dvd->ranges[j].pos;
+            }
+
+            av_get_frame_filename(filename, sizeof(filename), dvd->extract_output, i + 1);
+            ret = ffurl_open_whitelist(&out->url, filename, AVIO_FLAG_WRITE, &h->interrupt_callback, NULL,
+                                       h->protocol_whitelist, h->protocol_blacklist, h);
+            if (ret < 0) {
+                av_log(h, AV_LOG_ERROR, "could not open %s: %s\n", filename, av_err2str(ret));
+                goto end;
+            }
+            out->title = i + 1;
+            out->size = dvd->blocks * DVD_VIDEO_LB_LEN;
+            played += dvd->blocks;
+            nb_outputs++;
+        }
+        if (!nb_pieces) {
+            continue;
+        }
+
+        /* the read plan is the union of the pieces, in disc order */
+        qsort(pieces, nb_pieces, sizeof(*pieces), cmp_extract_piece);
+        av_freep(&dvd->ranges);
+        dvd->ranges = av_malloc_array(nb_pieces, sizeof(*dvd->ranges));
+        if (!dvd->ranges) {
+            ret = AVERROR(ENOMEM);
+            goto end;
+        }
+        dvd->nb_ranges = 0;
+        for (j = 0; j < nb_pieces; j++) {
+            DVDRange *range;
+
+            if (dvd->nb_ranges && pieces[j].first_sector <= dvd->ranges[dvd->nb_ranges - 1].last_sector + 1) {
+                range = &dvd->ranges[dvd->nb_ranges - 1];
+                range->last_sector = FFMAX(range->last_sector, pieces[j].last_sector);
+                continue;
+            }
+            range = &dvd->ranges[dvd->nb_ranges++];
+            memset(range, 0, sizeof(*range));
+            range->cell = pieces[j].cell;
+            range->first_sector = pieces[j].first_sector;
+            range->last_sector = pieces[j].last_sector;
+        }
+        dvd->stat_last_range = -1;
+
+        for (j = 0, k = 0; j < dvd->nb_ranges; j++) {
+            const DVDRange *range = &dvd->ranges[j];
+            uint32_t sector = range->first_sector;
+
+            /* the pieces of this range follow each other from k */
+            while (pieces[k].first_sector < range->first_sector) {
+                k++;
+            }
+
+            while (sector <= range->last_sector) {
+                int blocks = FFMIN(blocks_per_read, range->last_sector - sector + 1);
+                uint32_t last;
+
+                if (ff_check_interrupt(&h->interrupt_callback)) {
+                    ret = AVERROR_EXIT;
+                    goto end;
+                }
+                ret = read_sectors(h, j, sector, blocks, buf, &len);
+                if (ret < 0) {
+                    goto end;
+                }
+                av_assert1(len == ret);
+                unique += ret;
+                last = sector + ret - 1;
+
+                for (i = k; i < nb_pieces && pieces[i].first_sector <= last; i++) {
+                    const DVDExtractPiece *piece = &pieces[i];
+                    uint32_t first = FFMAX(piece->first_sector, sector);
+
+                    if (piece->last_sector < first) {
+                        continue;
+                    }
+                    ret = extract_write(h, &outputs[piece->output],
+                                        piece->pos + (int64_t)(first - piece->first_sector) * DVD_VIDEO_LB_LEN,
+                                        buf + (size_t)(first - sector) * DVD_VIDEO_LB_LEN,
+                                        (FFMIN(piece->last_sector, last) - first + 1) * DVD_VIDEO_LB_LEN);
+                    if (ret < 0) {
+                        goto end;
+                    }
+                }
+                sector = last + 1;
+            }
+        }
+    }
+
+    if (!nb_outputs) {
+        av_log(h, AV_LOG_ERROR, "no title to extract\n");
+        ret = AVERROR(EINVAL);
+        goto end;
+    }
+
+    av_log(h, AV_LOG_INFO, "extracted %d titles, %"PRId64" sectors played from %"PRId64" sectors read\n",
+           nb_outputs, played, unique);
+
+    av_bprint_init(&bp, 0, AV_BPRINT_SIZE_UNLIMITED);
+    for (i = 0; i < nb_outputs; i++) {
+        av_bprintf(&bp, "%s%d:%"PRId64, i ? " " : "", outputs[i].title, outputs[i].size);
+    }
+    av_freep(&dvd->extracted);
+    ret = av_bprint_finalize(&bp, &dvd->extracted);
+
+end:
+    /* the stream itself stays empty */
+    av_freep(&dvd->ranges);
+    dvd->nb_ranges = 0;
+    dvd->blocks = 0;
+    for (i = 0; i < nb_outputs; i++) {
+        ffurl_closep(&outputs[i].url);
+    }
+    av_free(outputs);
+    av_free(pieces);
+    av_free(selected);
+    av_free(buf);
+    return ret;
+}
+
+static int dvd_open(URLContext *h, const char *path, int flags)
+{
+    DVDContext *dvd = h->priv_data;
+    const DVDTitleInfo *info;
+    int num_title_idx;
+    int first_cell, last_cell;
+    int parsed = 0;
+    int ret, i;
+    const char *diskname = path;
+    char *cache_path = NULL;
+
+    dvd->sector_cache_disc = -1;
+    dvd->sector_cache_bad = -1;
+    av_strstart(path, DVD_PROTO_PREFIX, &diskname);
+
+    if (dvd->share_disc) {
+        ret = disc_acquire(h, diskname);
+        if (ret < 0) {
+            return ret;
+        }
+    } else {
+        dvd->dvd = DVDOpen(diskname);
+        if (dvd->dvd == 0) {
+            av_log(h, AV_LOG_ERROR, "DVDOpen() failed\n");
+            return AVERROR(EIO);
+        }
+        if (dvd->ifo_cache_dir || dvd->sector_cache_size) {
+            disc_identify(dvd->dvd, dvd->disc_id);
+        }
+    }
+
+    /* the cached title map holds each title's own program chain */
+    if (dvd->ifo_cache_dir && !dvd->pgc) {
+        cache_path = ifo_cache_path(h);
+        if (cache_path && ifo_cache_load(h, cache_path)) {
+            av_freep(&cache_path);
+        }
+    }
+
+    if (!dvd->titles) {
+        /* load DVD info, which also checks that the disc can be played */
+        dvd->vmg = open_ifo(dvd, 0);
+        if (dvd->vmg == NULL || dvd->vmg->vmgi_mat == NULL || dvd->vmg->tt_srpt == NULL) {
+            av_log(h, AV_LOG_ERROR, "ifoOpen() failed\n");
+            ret = AVERROR(EIO);
+            goto fail;
+        }
+
+        /* load title list */
+        dvd->nb_titles = dvd->vmg->tt_srpt->nr_of_srpts;
+        dvd->titles = av_mallocz_array(FFMAX(dvd->nb_titles, 1), sizeof(*dvd->titles));
+        if (!dvd->titles) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+        for (i = 0; i < dvd->nb_titles; i++) {
+            const title_info_t *title = &dvd->vmg->tt_srpt->title[i];
+            dvd->titles[i].title_set = title->title_set_nr;
+            dvd->titles[i].vts_ttn = title->vts_ttn;
+            dvd->titles[i].nr_of_angles = title->nr_of_angles;
+        }
+    }
+
+    num_title_idx = dvd->nb_titles;
+    av_log(h, AV_LOG_INFO, "%d usable titles\n", num_title_idx);
+    if (num_title_idx < 1) {
+        ret = AVERROR(EIO);
+        goto fail;
+    }
+
+    /* inventory only, the stream stays empty */
+    if (dvd->list_titles) {
+        ret = list_titles(h);
+        if (ret < 0) {
+            goto fail;
+        }
+        if (cache_path && !dvd->cache_buf) {
+            ifo_cache_store(h, cache_path);
+        }
+        av_free(cache_path);
+        return 0;
+    }
+
+    /* one pass over the disc writing several titles, the stream stays empty */
+    if (dvd->extract_titles) {
+        if (!dvd->cache_buf) {
+            ret = parse_titles(h, 1);
+            if (ret < 0) {
+                goto fail;
+            }
+        }
+        ret = extract_titles(h);
+        if (ret >= 0) {
+            ret = skip_publish(h);
+        }
+        if (ret < 0) {
+            goto fail;
+        }
+        if (cache_path && !dvd->cache_buf) {
+            ifo_cache_store(h, cache_path);
+        }
+        av_free(cache_path);
+        return 0;
+    }
+
+    /* ranking needs the program chain of every title */
+    if (dvd->title == 0) {
+        if (!dvd->cache_buf) {
+            ret = parse_titles(h, 1);
+            if (ret < 0) {
+                goto fail;
+            }
+            parsed = 1;
+        }
+        ret = select_main_title(h);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    /* play first title if none is given or exceeds boundary */
+    if (dvd->title < 1 || dvd->title > num_title_idx) {
+        av_log(h, AV_LOG_DEBUG, "title selection %d out of bounds, switching to title 1\n", dvd->title);
+        dvd->title = 1;
+    }
+
+    av_log(h, AV_LOG_INFO, "selected title %d\n", dvd->title);
+
+    /* select video title set */
+    info = &dvd->titles[dvd->title - 1];
+    dvd->title_set = info->title_set;
+    av_log(h, AV_LOG_DEBUG, "selected video title set %d\n", dvd->title_set);
+    av_log(h, AV_LOG_INFO, "DVD TTN: %d\n", info->vts_ttn);
+
+    /* load the program chains, of every title if they are going to be cached or compared */
+    if (!dvd->cache_buf) {
+        if (!parsed) {
+            ret = parse_titles(h, cache_path || dvd->cell_filter);
+            if (ret < 0) {
+                goto fail;
+            }
+        }
+        if (cache_path) {
+            ifo_cache_store(h, cache_path);
+            av_freep(&cache_path);
+        }
+    }
+
+    /* open DVD file */
+    disc_lock(dvd);
+    dvd->file = DVDOpenFile(dvd->dvd, dvd->title_set, DVD_READ_TITLE_VOBS);
+    disc_unlock(dvd);
+    if (dvd->file == 0) {
+        av_log(h, AV_LOG_ERROR, "DVDOpenFile() failed\n");
+        ret = AVERROR(EIO);
+        goto fail;
+    }
+
+    if (info->nr_of_cells == 0) {
+        av_log(h, AV_LOG_ERROR, "Program chain is broken\n");
+        ret = AVERROR(EIO);
+        goto fail;
+    }
+
+    /* cells */
+    dvd->cells = info->nr_of_cells;
+    av_log(h, AV_LOG_DEBUG, "number of cells for title: %d\n", dvd->cells);
+
+    /* chapters */
+    dvd->chapters = info->nr_of_chapters;
+    av_log(h, AV_LOG_DEBUG, "number of chapters for title: %d\n", dvd->chapters);
+
+    if (dvd->chapter_end == 0 || dvd->chapter_end > dvd->chapters) {
+        dvd->chapter_end = dvd->chapters;
+    }
+    if (dvd->chapter_start > dvd->chapter_end) {
+        av_log(h, AV_LOG_ERROR, "chapter range %d-%d is invalid, title has %d chapters\n",
+               dvd->chapter_start, dvd->chapter_end, dvd->chapters);
+        ret = AVERROR(EINVAL);
+        goto fail;
+    }
+
+    /* each chapter runs from its entry cell up to the next chapter's entry cell */
+    first_cell = dvd->chapter_cells[info->chapter_idx + dvd->chapter_start - 1];
+    if (dvd->chapter_end < dvd->chapters) {
+        last_cell = dvd->chapter_cells[info->chapter_idx + dvd->chapter_end] - 1;
+    } else {
+        last_cell = dvd->cells;
+    }
+    if (first_cell < 1 || last_cell > dvd->cells || first_cell > last_cell) {
+        av_log(h, AV_LOG_ERROR, "Chapter map is broken\n");
+        ret = AVERROR(EIO);
+        goto fail;
+    }
+    av_log(h, AV_LOG_INFO, "selected chapters %d-%d, cells %d-%d\n",
+           dvd->chapter_start, dvd->chapter_end, first_cell, last_cell);
+
+    if (dvd->cell_filter) {
+        ret = score_cells(h, info);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    /* read plan: only the sectors of the cells this title plays */
+    ret = build_ranges(h, info, first_cell, last_cell);
+    if (ret < 0) {
+        goto fail;
+    }
+    dvd->size = dvd->blocks * DVD_VIDEO_LB_LEN;
+    /* cells played more than once can make the plan larger than the VOBs */
+    dvd->stat_bytes_skipped = FFMAX(DVDFileSize(dvd->file) - dvd->blocks, 0) * DVD_VIDEO_LB_LEN;
+    dvd->stat_last_range = -1;
+
+    if (dvd->reorder_size) {
+        dvd->reorder_buf = av_mallocz_array(dvd->nb_ranges, sizeof(*dvd->reorder_buf));
+        dvd->reorder_list = av_malloc_array(dvd->nb_ranges, sizeof(*dvd->reorder_list));
+        if (!dvd->reorder_buf || !dvd->reorder_list) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
+
+    ret = build_chapters(h, info);
+    if (ret < 0) {
+        goto fail;
+    }
+
+    if (dvd->ifo_streams) {
+        ret = describe_streams(h, info);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    if (dvd->vobu_index) {
+        ret = build_keyframe_index(h);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    if (dvd->trace_file) {
+        ret = trace_open(h);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    /* set cell block offset */
+    dvd->cur_range = 0;
+    dvd->sector = dvd->ranges[0].first_sector;
+    dvd->offset = 0;
+
+    if (dvd->sector_cache_size && !dvd->disc_id[0]) {
+        av_log(h, AV_LOG_WARNING, "DVDDiscID() failed, not using the sector cache\n");
+    } else if (dvd->sector_cache_size) {
+        ret = sector_cache_join(h, dvd->disc_id);
+        if (ret < 0) {
+            goto fail;
+        }
+    }
+
+    dvd->probe_pos = -1;
+    if (dvd->probe_window) {
+        dvd->probe_window = FFMIN(dvd->probe_window, dvd->size);
+        dvd->probe_buf = av_malloc(FFMAX(dvd->probe_window, 1));
+        if (!dvd->probe_buf) {
+            ret = AVERROR(ENOMEM);
+            goto fail;
+        }
+    }
+
+    if (dvd->readahead) {
+#if HAVE_THREADS
+        ret = readahead_init(h);
+        if (ret < 0) {
+            goto fail;
+        }
+#else
+        av_log(h, AV_LOG_ERROR, "readahead requires thread support\n");
+        ret = AVERROR(ENOSYS);
+        goto fail;
+#endif
+    }
+
+    return 0;
+fail:
+    av_free(cache_path);
+    dvd_close(h);
+    return ret;
+}
+
+static void advance_sectors(DVDContext *dvd, int blocks)
+{
+    dvd->offset += blocks;
+    dvd->sector += blocks;
+
+    /* move on to the next cell */
+    if (dvd->sector > dvd->ranges[dvd->cur_range].last_sector && ++dvd->cur_range < dvd->nb_ranges) {
+        dvd->sector = dvd->ranges[dvd->cur_range].first_sector;
+    }
+}
+
+static int read_title(URLContext *h, unsigned char *buf, int size)
+{
+    DVDContext *dvd = h->priv_data;
+    const DVDRange *range;
+    int len, ret;
+    int blocks;
+
+#if HAVE_THREADS
+    if (dvd->ra_thread_started) {
+        return readahead_read(h, buf, size);
+    }
+#endif
+
+    /* dropped bad sectors produce no data, keep going until something does */
+    while (dvd->sector_pos >= dvd->sector_len) {
+        if (dvd->cur_range >= dvd->nb_ranges) {
+            return AVERROR_EOF;
+        }
+        range = &dvd->ranges[dvd->cur_range];
+
+        /* read as many whole sectors as fit, up to the end of the cell */
+        blocks = size / DVD_VIDEO_LB_LEN;
+        if (dvd->blocks_per_read > 0) {
+            blocks = FFMIN(blocks, dvd->blocks_per_read);
+        }
+        blocks = FFMIN(blocks, range->last_sector - dvd->sector + 1);
+
+        if (blocks > 0 && !dvd->sector_skip) {
+            ret = read_sectors(h, dvd->cur_range, dvd->sector, blocks, buf, &len);
+            if (ret < 0) {
+                return ret;
+            }
+            advance_sectors(dvd, ret);
+            /* the offset counts sectors handed out, not dropped ones */
+            dvd->offset -= ret - len;
+            if (len) {
+                return len * DVD_VIDEO_LB_LEN;
+            }
+            continue;
+        }
+
+        /* small read or seek into the middle of a sector, go through the bounce buffer */
+        ret = read_sectors(h, dvd->cur_range, dvd->sector, 1, dvd->sector_buf, &len);
+        if (ret < 0) {
+            return ret;
+        }
+        advance_sectors(dvd, 1);
+        if (!len) {
+            dvd->offset--;
+            continue;
+        }
+        dvd->sector_len = DVD_VIDEO_LB_LEN;
+        dvd->sector_pos = dvd->sector_skip;
+        dvd->sector_skip = 0;
+    }
+
+    /* hand out what is left of a partially consumed sector */
+    len = FFMIN(size, dvd->sector_len - dvd->sector_pos);
+    memcpy(buf, dvd->sector_buf + dvd->sector_pos, len);
+    dvd->sector_pos += len;
+
+    return len;
+}
+
+/* byte position of the next byte read_title() returns */
+static int64_t read_position(const DVDContext *dvd)
+{
+    return dvd->offset * DVD_VIDEO_LB_LEN - (dvd->sector_len - dvd->sector_pos) + dvd->sector_skip;
+}
+
+/* move the read cursor to a byte position inside the title */
+static void set_position(DVDContext *dvd, int64_t pos)
+{
+    int lo, hi;
+
+    dvd->sector_pos = dvd->sector_len = 0;
+    dvd->skip_left = 0;
+    dvd->offset = pos / DVD_VIDEO_LB_LEN;
+    dvd->sector_skip = pos % DVD_VIDEO_LB_LEN;
+
+    if (dvd->offset == dvd->blocks) {
+        dvd->cur_range = dvd->nb_ranges;
+        return;
+    }
+
+    /* find the cell holding the position */
+    lo = 0;
+    hi = dvd->nb_ranges - 1;
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (dvd->ranges[mid].pos <= pos) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    dvd->cur_range = lo;
+    dvd->sector = dvd->ranges[lo].first_sector + (pos - dvd->ranges[lo].pos) / DVD_VIDEO_LB_LEN;
+    av_assert1(pos >= dvd->ranges[lo].pos && dvd->sector <= dvd->ranges[lo].last_sector);
+}
+
+static int64_t seek_to(URLContext *h, int64_t pos)
+{
+    DVDContext *dvd = h->priv_data;
+
+    /* leave the disc where it is, dvd_read() catches up once past the window */
+    if (pos < dvd->probe_len) {
+        /* catching up would be a seek, unless the window ends where the disc is */
+        if (atomic_load(&dvd->dropped) && read_position(dvd) != dvd->probe_len) {
+            av_log(h, AV_LOG_ERROR, "cannot seek after dropping unreadable sectors\n");
+            return AVERROR(ESPIPE);
+        }
+        dvd->probe_pos = pos;
+        return pos;
+    }
+
+    /* the read plan no longer maps positions to sectors, only staying put works */
+    if (atomic_load(&dvd->dropped)) {
+        if (pos != read_position(dvd)) {
+            av_log(h, AV_LOG_ERROR, "cannot seek after dropping unreadable sectors\n");
+            return AVERROR(ESPIPE);
+        }
+        dvd->probe_pos = -1;
+        return pos;
+    }
+    dvd->probe_pos = -1;
+
+#if HAVE_THREADS
+
+    /* the worker reads from its own cursor, restart it at the new position */
+    if (dvd->ra_thread_started) {
+        int ret;
+
+        readahead_stop(dvd);
+        set_position(dvd, pos);
+        ret = readahead_start(h);
+        if (ret < 0) {
+            return ret;
+        }
+        return pos;
+    }
+#endif
+
+    set_position(dvd, pos);
+
+    return pos;
+}
+
+static int dvd_read(URLContext *h, unsigned char *buf, int size)
+{
+    DVDContext *dvd = h->priv_data;
+    int64_t pos;
+    int ret;
+
+    if (!dvd || !dvd->dvd) {
+        return AVERROR(EFAULT);
+    }
+
+    if (dvd->probe_pos >= 0) {
+        if (dvd->probe_pos < dvd->probe_len) {
+            ret = FFMIN(size, dvd->probe_len - dvd->probe_pos);
+            memcpy(buf, dvd->probe_buf + dvd->probe_pos, ret);
+            dvd->probe_pos += ret;
+            return ret;
+        }
+
+        /* past the window, carry on from the disc */
+        pos = dvd->probe_pos;
+        dvd->probe_pos = -1;
+        if (read_position(dvd) != pos) {
+            int64_t ret64 = seek_to(h, pos);
+            if (ret64 < 0) {
+                return ret64;
+            }
+        }
+    }
+
+    pos = read_position(dvd);
+    ret = read_title(h, buf, size);
+    if (skip_publish(h) < 0) {
+        return AVERROR(ENOMEM);
+    }
+
+    /* pin the data while the window is still being filled in order */
+    if (ret > 0 && pos == dvd->probe_len && pos < dvd->probe_window) {
+        int len = FFMIN(ret, dvd->probe_window - pos);
+        memcpy(dvd->probe_buf + pos, buf, len);
+        dvd->probe_len += len;
+    }
+
+    return ret;
+}
+
+static int64_t dvd_seek(URLContext *h, int64_t pos, int whence)
+{
+    DVDContext *dvd = h->priv_data;
+    int64_t size;
+
+    if (!dvd || !dvd->dvd) {
+        return AVERROR(EFAULT);
+    }
+
+    size = dvd->size;
+
+    switch (whence) {
+    case AVSEEK_SIZE:
+        /* dropped sectors make the title shorter than planned, by an amount not known up front */
+        return atomic_load(&dvd->dropped) ? AVERROR(ESPIPE) : size;
+    case SEEK_SET:
+        break;
+    case SEEK_CUR:
+        pos += dvd->probe_pos >= 0 ? dvd->probe_pos : read_position(dvd);
+        break;
+    case SEEK_END:
+        pos += size;
+        break;
+    default:
+        av_log(h, AV_LOG_ERROR, "Unsupported whence operation %d\n", whence);
+        return AVERROR(EINVAL);
+    }
+
+    if (pos < 0 || pos > size) {
+        return AVERROR(EINVAL);
+    }
+
+    return seek_to(h, pos);
+}
+
+/* index of the cell range holding a sector of the title set, -1 if it is not read */
+static int find_range(const DVDContext *dvd, uint32_t sector)
+{
+    int i;
+
+    for (i = 0; i < dvd->nb_ranges; i++) {
+        if (sector >= dvd->ranges[i].first_sector && sector <= dvd->ranges[i].last_sector) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int64_t sector_to_pos(const DVDContext *dvd, uint32_t sector)
+{
+    int i = find_range(dvd, sector);
+
+    if (i < 0) {
+        return -1;
+    }
+
+    return dvd->ranges[i].pos + (int64_t)(sector - dvd->ranges[i].first_sector) * DVD_VIDEO_LB_LEN;
+}
+
+/* round a sector down to the start of its VOBU using the VOBU address map */
+static uint32_t vobu_start(const DVDContext *dvd, uint32_t sector)
+{
+    const vobu_admap_t *admap = dvd->vts ? dvd->vts->vts_vobu_admap : NULL;
+    int lo, hi;
+
+    if (!admap || !admap->vobu_start_sectors || admap->last_byte < VOBU_ADMAP_SIZE) {
+        return sector;
+    }
+
+    lo = 0;
+    hi = (admap->last_byte + 1 - VOBU_ADMAP_SIZE) / 4 - 1;
+    if (hi < 0 || admap->vobu_start_sectors[0] > sector) {
+        return sector;
+    }
+    while (lo < hi) {
+        int mid = (lo + hi + 1) / 2;
+        if (admap->vobu_start_sectors[mid] <= sector) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+
+    return admap->vobu_start_sectors[lo];
+}
+
+/* use the title's time map, interpolating between its entries */
+static int64_t tmap_seek_pos(const DVDContext *dvd, uint32_t title_time)
+{
+    const DVDTitleInfo *info = &dvd->titles[dvd->title - 1];
+    const vts_tmapt_t *tmapt = dvd->vts ? dvd->vts->vts_tmapt : NULL;
+    const vts_tmap_t *tmap;
+    uint32_t interval, sector, next;
+    int idx, range;
+
+    /* the map is that of the first program chain only */
+    if (!tmapt || info->nr_of_pgcs > 1 || info->pgcn > tmapt->nr_of_tmaps || !tmapt->tmap) {
+        return -1;
+    }
+    tmap = &tmapt->tmap[info->pgcn - 1];
+    if (tmap->tmu == 0 || tmap->nr_of_entries == 0 || !tmap->map_ent) {
+        return -1;
+    }
+
+    /* entry n points at the VOBU playing at (n + 1) * tmu seconds */
+    interval = tmap->tmu * 1000;
+    idx = title_time / interval - 1;
+    if (idx < 0 || idx >= tmap->nr_of_entries) {
+        return -1;
+    }
+
+    sector = tmap->map_ent[idx] & 0x7fffffff;
+    range = find_range(dvd, sector);
+    if (range < 0) {
+        return -1;
+    }
+
+    /* the next entry tells how far the VOBUs go in one interval */
+    if (idx + 1 < tmap->nr_of_entries) {
+        next = tmap->map_ent[idx + 1] & 0x7fffffff;
+        if (next > sector && find_range(dvd, next) == range) {
+            sector = FFMAX(vobu_start(dvd, sector + (uint64_t)(next - sector) * (title_time % interval) / interval),
+                           sector);
+        }
+    }
+
+    return sector_to_pos(dvd, sector);
+}
+
+/* without a time map, interpolate inside the cell using its playback time */
+static int64_t cell_seek_pos(const DVDContext *dvd, uint32_t title_time)
+{
+    const DVDRange *range = &dvd->ranges[0];
+    uint32_t sector;
+    int i;
+
+    for (i = 0; i < dvd->nb_ranges; i++) {
+        if (dvd->ranges[i].time > title_time) {
+            break;
+        }
+        range = &dvd->ranges[i];
+    }
+
+    if (title_time < range->time) {
+        return range->pos;
+    }
+
+    sector = range->first_sector;
+    if (range->duration > 0 && title_time - range->time < range->duration) {
+        sector += (uint64_t)(range->last_sector - range->first_sector + 1) *
+                  (title_time - range->time) / range->duration;
+    } else if (title_time - range->time >= range->duration) {
+        sector = range->last_sector;
+    }
+
+    return sector_to_pos(dvd, FFMAX(vobu_start(dvd, sector), range->first_sector));
+}
+
+/*
+ * Timestamps are relative to the start of the selected chapters, in
+ * AV_TIME_BASE for stream_index -1 and in the 90 kHz MPEG-PS time base
+ * otherwise. The position lands on the start of the VOBU playing at or
+ * before the timestamp.
+ */
+static int64_t dvd_read_seek(URLContext *h, int stream_index, int64_t timestamp, int flags)
+{
+    DVDContext *dvd = h->priv_data;
+    uint32_t title_time;
+    int64_t pos;
+
+    if (!dvd || !dvd->dvd || !dvd->nb_ranges) {
+        return AVERROR(EFAULT);
+    }
+
+    if (stream_index < 0) {
+        timestamp /= AV_TIME_BASE / 1000;
+    } else {
+        timestamp /= 90;
+    }
+    timestamp = av_clip64(timestamp, 0, UINT32_MAX - dvd->start_time);
+    title_time = dvd->start_time + timestamp;
+
+    if (load_vts(h) < 0) {
+        av_log(h, AV_LOG_WARNING, "no title set IFO, seeking by cell playback time\n");
+    }
+
+    pos = tmap_seek_pos(dvd, title_time);
+    if (pos < 0) {
+        pos = cell_seek_pos(dvd, title_time);
+    }
+    if (pos < 0) {
+        return AVERROR(EINVAL);
+    }
+
+    av_log(h, AV_LOG_DEBUG, "time %"PRIu32" ms in title is at byte %"PRId64"\n", title_time, pos);
+
+    return seek_to(h, pos);
+}
 
 const URLProtocol ff_dvd_protocol = {
     .name            = "dvd",
@@ -262,6 +3421,7 @@ const URLProtocol ff_dvd_protocol = {
     .url_open        = dvd_open,
     .url_read        = dvd_read,
     .url_seek        = dvd_seek,
+    .url_read_seek   = dvd_read_seek,
     .priv_data_size  = sizeof(DVDContext),
     .priv_data_class = &dvd_context_class,
 };
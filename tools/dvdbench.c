@@ -0,0 +1,197 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Read throughput of input protocols, meant to compare dvd: against
+ * file: or concat: on the VOBs of the same title, e.g.
+ *
+ *   dvdbench -o title=2 dvd:movie.iso 'concat:VTS_02_1.VOB|VTS_02_2.VOB'
+ *
+ * Prints one JSON object per URL.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#if HAVE_SYS_RESOURCE_H
+#include <sys/time.h>
+#include <sys/resource.h>
+#endif
+
+#include "libavformat/avio.h"
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/time.h"
+
+static int64_t cpu_time(void)
+{
+#if HAVE_GETRUSAGE
+    struct rusage rusage;
+
+    getrusage(RUSAGE_SELF, &rusage);
+    return (int64_t)rusage.ru_utime.tv_sec * 1000000 + rusage.ru_utime.tv_usec +
+           (int64_t)rusage.ru_stime.tv_sec * 1000000 + rusage.ru_stime.tv_usec;
+#else
+    return 0;
+#endif
+}
+
+static int cmp_int64(const void *a, const void *b)
+{
+    int64_t va = *(const int64_t *)a, vb = *(const int64_t *)b;
+    return va < vb ? -1 : va > vb;
+}
+
+static void print_json_string(const char *s)
+{
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\')
+            putchar('\\');
+        if ((unsigned char)*s < 0x20)
+            printf("\\u%04x", *s);
+        else
+            putchar(*s);
+    }
+    putchar('"');
+}
+
+static int bench(const char *url, int buf_size, AVDictionary *opts)
+{
+    AVDictionary *url_opts = NULL;
+    AVIOContext *pb = NULL;
+    uint8_t *buf;
+    int64_t *lat = NULL;
+    unsigned lat_size = 0;
+    int64_t calls = 0, bytes = 0, wall, cpu;
+    double secs;
+    int ret;
+
+    buf = av_malloc(buf_size);
+    if (!buf)
+        return AVERROR(ENOMEM);
+
+    av_dict_copy(&url_opts, opts, 0);
+    /* direct reads, so the protocol is asked for buf_size bytes at a time */
+    ret = avio_open2(&pb, url, AVIO_FLAG_READ | AVIO_FLAG_DIRECT, NULL, &url_opts);
+    av_dict_free(&url_opts);
+    if (ret < 0) {
+        fprintf(stderr, "Cannot open %s: %s\n", url, av_err2str(ret));
+        av_free(buf);
+        return ret;
+    }
+
+    wall = av_gettime_relative();
+    cpu  = cpu_time();
+    for (;;) {
+        int64_t t = av_gettime_relative();
+
+        ret = avio_read(pb, buf, buf_size);
+        if (ret <= 0)
+            break;
+
+        if (calls >= lat_size / sizeof(*lat)) {
+            int64_t *tmp = av_fast_realloc(lat, &lat_size, (calls + 1) * sizeof(*lat));
+            if (!tmp) {
+                ret = AVERROR(ENOMEM);
+                break;
+            }
+            lat = tmp;
+        }
+        lat[calls++] = av_gettime_relative() - t;
+        bytes += ret;
+    }
+    wall = av_gettime_relative() - wall;
+    cpu  = cpu_time() - cpu;
+    avio_closep(&pb);
+    av_free(buf);
+
+    if (ret < 0 && ret != AVERROR_EOF) {
+        fprintf(stderr, "Error reading %s: %s\n", url, av_err2str(ret));
+        av_free(lat);
+        return ret;
+    }
+
+    qsort(lat, calls, sizeof(*lat), cmp_int64);
+    secs = wall / 1000000.0;
+
+    printf("{\"url\":");
+    print_json_string(url);
+    printf(",\"buffer_size\":%d,\"bytes\":%"PRId64",\"calls\":%"PRId64
+           ",\"wall_s\":%.6f,\"cpu_s\":%.6f,\"mb_per_s\":%.3f,\"calls_per_s\":%.1f"
+           ",\"cpu_s_per_gb\":%.3f,\"latency_p50_us\":%"PRId64",\"latency_p99_us\":%"PRId64"}\n",
+           buf_size, bytes, calls, secs, cpu / 1000000.0,
+           secs > 0 ? bytes / secs / 1e6 : 0.0,
+           secs > 0 ? calls / secs : 0.0,
+           bytes > 0 ? cpu / 1000000.0 / (bytes / 1e9) : 0.0,
+           calls ? lat[calls / 2] : 0, calls ? lat[calls * 99 / 100] : 0);
+    fflush(stdout);
+
+    av_free(lat);
+    return 0;
+}
+
+static void usage(const char *name)
+{
+    fprintf(stderr, "Usage: %s [-b buffer_size] [-n passes] [-o key=value[:key=value...]] url [url...]\n"
+            "Reads each url to the end and prints its throughput as JSON, one object per line.\n"
+            "Options given with -o are passed to every url, e.g. -o title=2:chapter_start=3\n",
+            name);
+}
+
+int main(int argc, char **argv)
+{
+    AVDictionary *opts = NULL;
+    int buf_size = 32768, passes = 1;
+    int i, j, pass, ret = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+            buf_size = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-n") && i + 1 < argc) {
+            passes = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "-o") && i + 1 < argc) {
+            if (av_dict_parse_string(&opts, argv[++i], "=", ":", 0) < 0) {
+                fprintf(stderr, "Invalid options %s\n", argv[i]);
+                return 1;
+            }
+        } else if (argv[i][0] == '-') {
+            usage(argv[0]);
+            return 1;
+        } else {
+            break;
+        }
+    }
+
+    if (i >= argc || buf_size <= 0 || passes <= 0) {
+        usage(argv[0]);
+        av_dict_free(&opts);
+        return 1;
+    }
+
+    for (pass = 0; pass < passes; pass++)
+        for (j = i; j < argc; j++)
+            if (bench(argv[j], buf_size, opts) < 0)
+                ret = 1;
+
+    av_dict_free(&opts);
+    return ret;
+}
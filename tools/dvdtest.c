@@ -0,0 +1,1077 @@
+/*
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * Checks of the dvd: protocol against a synthetic disc, no drive or image
+ * needed. This program defines the libdvdread functions the protocol calls,
+ * and those take precedence over libdvdread's when linking, so dvd:synthetic
+ * opens the VIDEO_TS described below. Every sector holds its title set and
+ * sector number, so each read can be compared byte for byte with the sectors
+ * the selection should produce.
+ *
+ *   make tools/dvdtest && tools/dvdtest
+ *
+ * Prints one line per check, exits with 1 if any failed.
+ */
+
+#include "config.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <dvdread/dvd_reader.h>
+#include <dvdread/ifo_read.h>
+
+#include "libavformat/avio.h"
+#include "libavutil/common.h"
+#include "libavutil/dict.h"
+#include "libavutil/error.h"
+#include "libavutil/mem.h"
+#include "libavutil/opt.h"
+#include "libavutil/time.h"
+
+#define SECTOR 2048
+#define VOBU   25
+
+typedef struct TestCell {
+    uint32_t first_sector;
+    uint32_t last_sector;
+    int seconds;
+    int block_type;
+    int block_mode;
+} TestCell;
+
+typedef struct TestPGC {
+    int nb_cells;
+    TestCell cells[8];
+    int nb_programs;
+    uint8_t program_map[8];
+    int tmu;                    /* time map interval in seconds, 0 for no map */
+    int nb_entries;
+    uint32_t map_ent[4];
+} TestPGC;
+
+typedef struct TestTTU {
+    int nb_ptts;
+    ptt_info_t ptt[8];
+} TestTTU;
+
+typedef struct TestVTS {
+    uint32_t sectors;
+    int nb_pgcs;
+    TestPGC pgcs[4];
+    int nb_ttus;
+    TestTTU ttus[4];
+} TestVTS;
+
+typedef struct TestTitle {
+    int title_set;
+    int ttn;
+    int angles;
+} TestTitle;
+
+/*
+ * Title 1 plays its cells out of disc order, in three chapters.
+ * Title 2 is a single cell further on in the same title set.
+ * Title 3 has a two angle block, of which only the first angle is read.
+ * Title 4 runs over two program chains, the second shared with title 2.
+ * Title 5 has three programs but two chapters, the second at program 3.
+ * Only title 2 has a time map, and it is not linear in the sectors. VOBUs
+ * start every 25 sectors.
+ */
+static const TestVTS disc_vts[] = {
+    {
+        .sectors = 3000,
+        .nb_pgcs = 4,
+        .pgcs = {
+            { 4, { { 0, 499, 100 }, { 500, 999, 100 }, { 2000, 2499, 100 }, { 1000, 1499, 100 } },
+              3, { 1, 3, 4 } },
+            { 1, { { 2500, 2999, 30 } }, 1, { 1 }, 10, 2, { 2600, 2900 } },
+            { 1, { { 1500, 1999, 50 } }, 1, { 1 } },
+            { 3, { { 0, 199, 20 }, { 200, 299, 10 }, { 300, 399, 10 } }, 3, { 1, 2, 3 } },
+        },
+        .nb_ttus = 4,
+        .ttus = {
+            { 3, { { 1, 1 }, { 1, 2 }, { 1, 3 } } },
+            { 1, { { 2, 1 } } },
+            { 2, { { 3, 1 }, { 2, 1 } } },
+            { 2, { { 4, 1 }, { 4, 3 } } },
+        },
+    },
+    {
+        .sectors = 1000,
+        .nb_pgcs = 1,
+        .pgcs = {
+            { 4, { { 0, 99, 10 },
+                   { 100, 199, 10, BLOCK_TYPE_ANGLE_BLOCK, BLOCK_MODE_FIRST_CELL },
+                   { 200, 299, 10, BLOCK_TYPE_ANGLE_BLOCK, BLOCK_MODE_LAST_CELL },
+                   { 300, 999, 70 } },
+              1, { 1 } },
+        },
+        .nb_ttus = 1,
+        .ttus = {
+            { 1, { { 1, 1 } } },
+        },
+    },
+};
+
+static const TestTitle disc_titles[] = {
+    { 1, 1, 1 },
+    { 1, 2, 1 },
+    { 2, 1, 2 },
+    { 1, 3, 1 },
+    { 1, 4, 1 },
+};
+
+#define NB_VTS    FF_ARRAY_ELEMS(disc_vts)
+#define NB_TITLES FF_ARRAY_ELEMS(disc_titles)
+
+/* handles still open and sectors served, to catch leaks and overreads */
+static int open_readers, open_files, open_ifos;
+static int64_t sectors_served;
+
+/* reads that went back on the disc, the next sector in disc order */
+static int backward_reads;
+static uint32_t next_offset;
+
+/* sectors of one title set that fail every read covering them */
+static int bad_title_set;
+static uint32_t bad_first, bad_last;
+
+/* microseconds each read takes, like a drive spinning up */
+static int read_delay;
+
+/* title set whose IFO cannot be opened */
+static int broken_ifo;
+
+/* bumped to put another disc with the same layout in the drive */
+static int media;
+
+struct dvd_reader_s {
+    int dummy;
+};
+
+struct dvd_file_s {
+    int title_set;
+};
+
+static void fill_sector(int title_set, uint32_t sector, uint8_t *buf)
+{
+    memset(buf, (sector * 7 + title_set + media) & 0xff, SECTOR);
+    buf[0] = title_set;
+    buf[1] = sector >> 16;
+    buf[2] = sector >> 8;
+    buf[3] = sector;
+}
+
+dvd_reader_t *DVDOpen(const char *path)
+{
+    if (strcmp(path, "synthetic")) {
+        return NULL;
+    }
+    open_readers++;
+    return calloc(1, sizeof(dvd_reader_t));
+}
+
+void DVDClose(dvd_reader_t *dvd)
+{
+    if (dvd) {
+        open_readers--;
+        free(dvd);
+    }
+}
+
+dvd_file_t *DVDOpenFile(dvd_reader_t *dvd, int title_set, dvd_read_domain_t domain)
+{
+    dvd_file_t *file;
+
+    if (title_set < 1 || title_set > NB_VTS || domain != DVD_READ_TITLE_VOBS) {
+        return NULL;
+    }
+    file = calloc(1, sizeof(*file));
+    if (file) {
+        file->title_set = title_set;
+        open_files++;
+    }
+    return file;
+}
+
+void DVDCloseFile(dvd_file_t *file)
+{
+    if (file) {
+        open_files--;
+        free(file);
+    }
+}
+
+ssize_t DVDReadBlocks(dvd_file_t *file, int offset, size_t blocks, unsigned char *buf)
+{
+    uint32_t sectors = disc_vts[file->title_set - 1].sectors;
+    size_t i;
+
+    if (offset < 0 || offset >= sectors) {
+        return -1;
+    }
+    blocks = FFMIN(blocks, sectors - offset);
+    if (read_delay) {
+        usleep(read_delay);
+    }
+    if (file->title_set == bad_title_set && offset <= bad_last && offset + blocks > bad_first) {
+        return -1;
+    }
+    for (i = 0; i < blocks; i++) {
+        fill_sector(file->title_set, offset + i, buf + i * SECTOR);
+    }
+    sectors_served += blocks;
+    backward_reads += offset < next_offset;
+    next_offset = offset + blocks;
+    return blocks;
+}
+
+ssize_t DVDFileSize(dvd_file_t *file)
+{
+    return disc_vts[file->title_set - 1].sectors;
+}
+
+int DVDDiscID(dvd_reader_t *dvd, unsigned char *disc_id)
+{
+    memset(disc_id, 0x5a + media, 16);
+    return 0;
+}
+
+static void set_time(dvd_time_t *time, int seconds)
+{
+#define BCD(x) ((((x) / 10) << 4) | ((x) % 10))
+    time->hour = BCD(seconds / 3600);
+    time->minute = BCD(seconds / 60 % 60);
+    time->second = BCD(seconds % 60);
+    time->frame_u = 0xc0; /* 30 fps, no frames */
+}
+
+static pgc_t *make_pgc(const TestPGC *tp)
+{
+    pgc_t *pgc = calloc(1, sizeof(*pgc));
+    int i, total = 0;
+
+    pgc->nr_of_cells = tp->nb_cells;
+    pgc->nr_of_programs = tp->nb_programs;
+    pgc->program_map = calloc(tp->nb_programs, sizeof(*pgc->program_map));
+    memcpy(pgc->program_map, tp->program_map, tp->nb_programs);
+    pgc->cell_playback = calloc(tp->nb_cells, sizeof(*pgc->cell_playback));
+    for (i = 0; i < tp->nb_cells; i++) {
+        const TestCell *tc = &tp->cells[i];
+        cell_playback_t *cell = &pgc->cell_playback[i];
+
+        cell->first_sector = tc->first_sector;
+        cell->last_sector = tc->last_sector;
+        cell->last_vobu_start_sector = tc->last_sector;
+        cell->block_type = tc->block_type;
+        cell->block_mode = tc->block_mode;
+        set_time(&cell->playback_time, tc->seconds);
+        if (tc->block_type != BLOCK_TYPE_ANGLE_BLOCK || tc->block_mode == BLOCK_MODE_FIRST_CELL) {
+            total += tc->seconds;
+        }
+    }
+    set_time(&pgc->playback_time, total);
+
+    return pgc;
+}
+
+ifo_handle_t *ifoOpen(dvd_reader_t *dvd, int title_set)
+{
+    ifo_handle_t *ifo;
+    const TestVTS *vts;
+    int i;
+
+    if (title_set < 0 || title_set > NB_VTS || (broken_ifo && title_set == broken_ifo)) {
+        return NULL;
+    }
+    ifo = calloc(1, sizeof(*ifo));
+    open_ifos++;
+
+    if (!title_set) {
+        ifo->vmgi_mat = calloc(1, sizeof(*ifo->vmgi_mat));
+        ifo->vmgi_mat->vmg_nr_of_title_sets = NB_VTS;
+        ifo->tt_srpt = calloc(1, sizeof(*ifo->tt_srpt));
+        ifo->tt_srpt->nr_of_srpts = NB_TITLES;
+        ifo->tt_srpt->title = calloc(NB_TITLES, sizeof(*ifo->tt_srpt->title));
+        for (i = 0; i < NB_TITLES; i++) {
+            title_info_t *title = &ifo->tt_srpt->title[i];
+            title->title_set_nr = disc_titles[i].title_set;
+            title->vts_ttn = disc_titles[i].ttn;
+            title->nr_of_angles = disc_titles[i].angles;
+            title->nr_of_ptts = disc_vts[disc_titles[i].title_set - 1].ttus[disc_titles[i].ttn - 1].nb_ptts;
+        }
+        return ifo;
+    }
+
+    vts = &disc_vts[title_set - 1];
+    ifo->vtsi_mat = calloc(1, sizeof(*ifo->vtsi_mat));
+    ifo->vts_ptt_srpt = calloc(1, sizeof(*ifo->vts_ptt_srpt));
+    ifo->vts_ptt_srpt->nr_of_srpts = vts->nb_ttus;
+    ifo->vts_ptt_srpt->title = calloc(vts->nb_ttus, sizeof(*ifo->vts_ptt_srpt->title));
+    for (i = 0; i < vts->nb_ttus; i++) {
+        ttu_t *ttu = &ifo->vts_ptt_srpt->title[i];
+        ttu->nr_of_ptts = vts->ttus[i].nb_ptts;
+        ttu->ptt = calloc(ttu->nr_of_ptts, sizeof(*ttu->ptt));
+        memcpy(ttu->ptt, vts->ttus[i].ptt, ttu->nr_of_ptts * sizeof(*ttu->ptt));
+    }
+    ifo->vts_pgcit = calloc(1, sizeof(*ifo->vts_pgcit));
+    ifo->vts_pgcit->nr_of_pgci_srp = vts->nb_pgcs;
+    ifo->vts_pgcit->pgci_srp = calloc(vts->nb_pgcs, sizeof(*ifo->vts_pgcit->pgci_srp));
+    for (i = 0; i < vts->nb_pgcs; i++) {
+        ifo->vts_pgcit->pgci_srp[i].pgc = make_pgc(&vts->pgcs[i]);
+    }
+
+    ifo->vts_tmapt = calloc(1, sizeof(*ifo->vts_tmapt));
+    ifo->vts_tmapt->nr_of_tmaps = vts->nb_pgcs;
+    ifo->vts_tmapt->tmap = calloc(vts->nb_pgcs, sizeof(*ifo->vts_tmapt->tmap));
+    for (i = 0; i < vts->nb_pgcs; i++) {
+        vts_tmap_t *tmap = &ifo->vts_tmapt->tmap[i];
+        tmap->tmu = vts->pgcs[i].tmu;
+        tmap->nr_of_entries = vts->pgcs[i].nb_entries;
+        tmap->map_ent = calloc(FFMAX(tmap->nr_of_entries, 1), sizeof(*tmap->map_ent));
+        memcpy(tmap->map_ent, vts->pgcs[i].map_ent, tmap->nr_of_entries * sizeof(*tmap->map_ent));
+    }
+
+    ifo->vts_vobu_admap = calloc(1, sizeof(*ifo->vts_vobu_admap));
+    ifo->vts_vobu_admap->last_byte = VOBU_ADMAP_SIZE - 1 + vts->sectors / VOBU * 4;
+    ifo->vts_vobu_admap->vobu_start_sectors = calloc(vts->sectors / VOBU, sizeof(uint32_t));
+    for (i = 0; i < vts->sectors / VOBU; i++) {
+        ifo->vts_vobu_admap->vobu_start_sectors[i] = i * VOBU;
+    }
+
+    return ifo;
+}
+
+void ifoClose(ifo_handle_t *ifo)
+{
+    int i;
+
+    if (!ifo) {
+        return;
+    }
+    open_ifos--;
+    if (ifo->vmgi_mat) {
+        free(ifo->tt_srpt->title);
+        free(ifo->tt_srpt);
+        free(ifo->vmgi_mat);
+    }
+    if (ifo->vtsi_mat) {
+        for (i = 0; i < ifo->vts_pgcit->nr_of_pgci_srp; i++) {
+            pgc_t *pgc = ifo->vts_pgcit->pgci_srp[i].pgc;
+            free(pgc->program_map);
+            free(pgc->cell_playback);
+            free(pgc);
+        }
+        free(ifo->vts_pgcit->pgci_srp);
+        free(ifo->vts_pgcit);
+        for (i = 0; i < ifo->vts_tmapt->nr_of_tmaps; i++) {
+            free(ifo->vts_tmapt->tmap[i].map_ent);
+        }
+        free(ifo->vts_tmapt->tmap);
+        free(ifo->vts_tmapt);
+        free(ifo->vts_vobu_admap->vobu_start_sectors);
+        free(ifo->vts_vobu_admap);
+        for (i = 0; i < ifo->vts_ptt_srpt->nr_of_srpts; i++) {
+            free(ifo->vts_ptt_srpt->title[i].ptt);
+        }
+        free(ifo->vts_ptt_srpt->title);
+        free(ifo->vts_ptt_srpt);
+        free(ifo->vtsi_mat);
+    }
+    free(ifo);
+}
+
+static int failures;
+
+static void report(const char *name, int ok)
+{
+    printf("%-40s %s\n", name, ok ? "ok" : "FAILED");
+    if (!ok) {
+        failures++;
+    }
+}
+
+/* the sectors first-last of a title set, for each pair in ranges */
+static uint8_t *expected(int title_set, const uint32_t *ranges, int nb_ranges, int64_t *size)
+{
+    uint8_t *buf;
+    int64_t len = 0;
+    uint32_t s;
+    int i;
+
+    for (i = 0; i < nb_ranges; i++) {
+        len += (int64_t)(ranges[2 * i + 1] - ranges[2 * i] + 1) * SECTOR;
+    }
+    buf = av_malloc(FFMAX(len, 1));
+    if (!buf) {
+        exit(1);
+    }
+    *size = len;
+    for (i = 0, len = 0; i < nb_ranges; i++) {
+        for (s = ranges[2 * i]; s <= ranges[2 * i + 1]; s++, len += SECTOR) {
+            fill_sector(title_set, s, buf + len);
+        }
+    }
+    return buf;
+}
+
+static int open_title(AVIOContext **pb, const char *options)
+{
+    AVDictionary *opts = NULL;
+    int ret;
+
+    if (options && av_dict_parse_string(&opts, options, "=", ":", 0) < 0) {
+        return AVERROR(EINVAL);
+    }
+    /* direct, so the protocol sees every read size asked for */
+    ret = avio_open2(pb, "dvd:synthetic", AVIO_FLAG_READ | AVIO_FLAG_DIRECT, NULL, &opts);
+    av_dict_free(&opts);
+    return ret;
+}
+
+/* read everything with buf_size reads and compare with the expected bytes */
+static int read_compare(AVIOContext *pb, int buf_size, const uint8_t *ref, int64_t ref_size)
+{
+    uint8_t *buf = av_malloc(buf_size);
+    int64_t pos = 0;
+    int ret, ok = 1;
+
+    if (!buf) {
+        return 0;
+    }
+    while ((ret = avio_read(pb, buf, buf_size)) > 0) {
+        if (pos + ret > ref_size || memcmp(buf, ref + pos, ret)) {
+            ok = 0;
+            break;
+        }
+        pos += ret;
+    }
+    av_free(buf);
+    return ok && pos == ref_size && (ret == 0 || ret == AVERROR_EOF);
+}
+
+static int check_read(const char *options, int buf_size, int title_set,
+                      const uint32_t *ranges, int nb_ranges)
+{
+    AVIOContext *pb = NULL;
+    int64_t size;
+    uint8_t *ref = expected(title_set, ranges, nb_ranges, &size);
+    int ok;
+
+    if (open_title(&pb, options) < 0) {
+        av_free(ref);
+        return 0;
+    }
+    ok = avio_size(pb) == size && read_compare(pb, buf_size, ref, size);
+    avio_closep(&pb);
+    av_free(ref);
+    return ok;
+}
+
+static int check_seek(const char *options, int title_set, const uint32_t *ranges, int nb_ranges)
+{
+    AVIOContext *pb = NULL;
+    int64_t size, pos;
+    uint8_t *ref = expected(title_set, ranges, nb_ranges, &size);
+    uint8_t buf[3000];
+    int i, ret, ok = 1;
+
+    if (open_title(&pb, options) < 0) {
+        av_free(ref);
+        return 0;
+    }
+    /* odd offsets and lengths, crossing sector and cell boundaries */
+    for (i = 0; i < 300 && ok; i++) {
+        pos = (int64_t)(i * 7919 % (size / SECTOR)) * SECTOR + i % 5 * 333;
+        if (avio_seek(pb, pos, SEEK_SET) != pos) {
+            ok = 0;
+            break;
+        }
+        ret = avio_read(pb, buf, sizeof(buf));
+        ok = ret > 0 && pos + ret <= size && !memcmp(buf, ref + pos, ret);
+    }
+    ok = ok && avio_seek(pb, size, SEEK_SET) == size && avio_read(pb, buf, sizeof(buf)) <= 0;
+    avio_closep(&pb);
+    av_free(ref);
+    return ok;
+}
+
+static void check_titles(void)
+{
+    static const uint32_t title1[] = { 0, 499, 500, 999, 2000, 2499, 1000, 1499 };
+    static const uint32_t title2[] = { 2500, 2999 };
+    static const uint32_t title3[] = { 0, 99, 100, 199, 300, 999 };
+    static const uint32_t title4[] = { 1500, 1999, 2500, 2999 };
+
+    report("title 1, cells in playback order", check_read("title=1", 65536, 1, title1, 4));
+    report("title 1, reads smaller than a sector", check_read("title=1", 1000, 1, title1, 4));
+    report("title 1, blocks_per_read=3", check_read("title=1:blocks_per_read=3", 32768, 1, title1, 4));
+    report("title 2, not the rest of the title set", check_read("title=2", 65536, 1, title2, 1));
+    report("title 3, first angle only", check_read("title=3", 65536, 2, title3, 3));
+    report("title 4, both program chains", check_read("title=4", 65536, 1, title4, 2));
+#if HAVE_THREADS
+    report("title 1, readahead", check_read("title=1:readahead=1:readahead_size=64", 7000, 1, title1, 4));
+#endif
+}
+
+static void check_chapters(void)
+{
+    static const uint32_t title1[] = { 0, 499, 500, 999, 2000, 2499, 1000, 1499 };
+    static const uint32_t title4[] = { 1500, 1999, 2500, 2999 };
+    static const uint32_t title5[] = { 0, 199, 200, 299, 300, 399 };
+    AVIOContext *pb = NULL;
+    int64_t served;
+
+    report("title 1, chapter 2 on", check_read("title=1:chapter_start=2", 65536, 1, title1 + 4, 2));
+    report("title 1, chapters 1-2", check_read("title=1:chapter_end=2", 65536, 1, title1, 3));
+    report("title 1, chapter 2", check_read("title=1:chapter_start=2:chapter_end=2", 65536, 1, title1 + 4, 1));
+
+    served = sectors_served;
+    report("title 1, chapter 3", check_read("title=1:chapter_start=3", 65536, 1, title1 + 6, 1));
+    report("title 1, chapter 3 reads only its cell", sectors_served - served == 500);
+    report("title 4, second program chain", check_read("title=4:chapter_start=2", 65536, 1, title4 + 2, 1));
+    report("title 5, chapter 1 is programs 1-2", check_read("title=5:chapter_end=1", 65536, 1, title5, 2));
+    report("title 5, chapter 2 is program 3", check_read("title=5:chapter_start=2", 65536, 1, title5 + 4, 1));
+    report("title 5, no chapter 3", open_title(&pb, "title=5:chapter_start=3") < 0);
+    /* titles may have up to 999 chapters, the option takes them but title 5 has 2 */
+    report("title 5, no chapter 150", open_title(&pb, "title=5:chapter_start=150:chapter_end=999") < 0);
+}
+
+/* rewinds inside the window are served from memory, the disc is read once */
+static void check_probe_window(void)
+{
+    static const uint32_t title1[] = { 0, 499, 500, 999, 2000, 2499, 1000, 1499 };
+    AVIOContext *pb = NULL;
+    uint8_t buf[SECTOR];
+    int64_t size, served, read = -1;
+    uint8_t *ref = expected(1, title1, 4, &size);
+    int i, ok;
+
+    served = sectors_served;
+    ok = open_title(&pb, "title=1:probe_window=1048576") >= 0;
+    for (i = 0; i < 300 && ok; i++) {
+        ok = avio_read(pb, buf, sizeof(buf)) == sizeof(buf);
+    }
+    ok = ok && avio_seek(pb, 100000, SEEK_SET) == 100000 && avio_read(pb, buf, sizeof(buf)) == sizeof(buf) &&
+         !memcmp(buf, ref + 100000, sizeof(buf));
+    ok = ok && av_opt_get_int(pb, "sectors_read", AV_OPT_SEARCH_CHILDREN, &read) >= 0;
+    report("probe window, rewind served from memory", ok && read == 300 && sectors_served - served == 300);
+    ok = ok && avio_seek(pb, 0, SEEK_SET) == 0 && read_compare(pb, SECTOR, ref, size);
+    report("probe window, rewind and read on", ok && sectors_served - served == 2000);
+
+    /* past the window seeks go back to the disc */
+    ok = ok && avio_seek(pb, 600 * SECTOR, SEEK_SET) == 600 * SECTOR &&
+         avio_read(pb, buf, sizeof(buf)) == sizeof(buf) && !memcmp(buf, ref + 600 * SECTOR, sizeof(buf));
+    avio_closep(&pb);
+    report("probe window, seek past it", ok && sectors_served - served > 2000);
+
+#if HAVE_THREADS
+    ok = open_title(&pb, "title=1:probe_window=1048576:readahead=1:readahead_size=64") >= 0;
+    for (i = 0; i < 300 && ok; i++) {
+        ok = avio_read(pb, buf, sizeof(buf)) == sizeof(buf);
+    }
+    ok = ok && avio_seek(pb, 0, SEEK_SET) == 0 && read_compare(pb, 7000, ref, size);
+    avio_closep(&pb);
+    report("probe window, readahead", ok);
+#endif
+    av_free(ref);
+}
+
+/* seek to a time in ms from the start of the selection, then read the sector found there */
+static int check_time_seek(const char *options, int64_t ms, int title_set, uint32_t sector, int64_t pos)
+{
+    AVIOContext *pb = NULL;
+    uint8_t buf[SECTOR], ref[SECTOR];
+    int ok;
+
+    if (open_title(&pb, options) < 0) {
+        return 0;
+    }
+    fill_sector(title_set, sector, ref);
+    ok = avio_seek_time(pb, -1, ms * 1000, 0) == pos &&
+         avio_read(pb, buf, sizeof(buf)) == sizeof(buf) && !memcmp(buf, ref, sizeof(buf));
+    avio_closep(&pb);
+    return ok;
+}
+
+static void check_time_seeks(void)
+{
+    /* title 2, 30 seconds over sectors 2500-2999, the time map puts 10 s at 2600 and 20 s at 2900 */
+    report("time seek, on a time map entry", check_time_seek("title=2", 10000, 1, 2600, 100 * SECTOR));
+    report("time seek, between time map entries", check_time_seek("title=2", 15000, 1, 2750, 250 * SECTOR));
+    report("time seek, before the first entry", check_time_seek("title=2", 5000, 1, 2575, 75 * SECTOR));
+
+    /* title 1 has no time map, cell 3 plays from 200 s over sectors 2000-2499 */
+    report("time seek, by cell time", check_time_seek("title=1", 250000, 1, 2250, 1250 * SECTOR));
+    report("time seek, from chapter 2", check_time_seek("title=1:chapter_start=2", 10000, 1, 2050, 50 * SECTOR));
+    report("time seek, rounded to a VOBU", check_time_seek("title=1", 3000, 1, 0, 0));
+}
+
+static void check_vobu_index(void)
+{
+    AVIOContext *pb = NULL;
+    uint8_t *index = NULL;
+    char ref[1024];
+    int i, len = 0, ok;
+
+    /* title 2 is 20 VOBUs over 30 seconds */
+    for (i = 0; i < 20; i++) {
+        len += snprintf(ref + len, sizeof(ref) - len, "%s%d:%d", i ? " " : "", i * VOBU * SECTOR, i * 1500000);
+    }
+    ok = open_title(&pb, "title=2:vobu_index=1") >= 0 &&
+         av_opt_get(pb, "keyframe_index", AV_OPT_SEARCH_CHILDREN, &index) >= 0 &&
+         index && !strcmp((char *)index, ref);
+    av_free(index);
+    avio_closep(&pb);
+    report("keyframe index from the VOBU map", ok);
+}
+
+static void check_seeks(void)
+{
+    static const uint32_t title1[] = { 0, 499, 500, 999, 2000, 2499, 1000, 1499 };
+
+    report("title 1, seeks", check_seek("title=1", 1, title1, 4));
+    report("title 1 chapter 2 on, seeks", check_seek("title=1:chapter_start=2", 1, title1 + 4, 2));
+#if HAVE_THREADS
+    report("title 1, seeks with readahead", check_seek("title=1:readahead=1:readahead_size=64", 1, title1, 4));
+#endif
+}
+
+static int interrupt_at(void *opaque)
+{
+    return sectors_served >= *(int64_t *)opaque;
+}
+
+static int interrupt_after(void *opaque)
+{
+    return av_gettime_relative() >= *(int64_t *)opaque;
+}
+
+#if HAVE_THREADS
+/* a read waiting on a slow drive returns soon after the interrupt, not when the drive answers */
+static void check_readahead_interrupt(void)
+{
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    AVIOInterruptCB int_cb = { interrupt_after, NULL };
+    uint8_t buf[SECTOR];
+    int64_t deadline = INT64_MAX;
+    int ok, ret = 0;
+
+    int_cb.opaque = &deadline;
+    read_delay = 1000000;
+    ok = av_dict_parse_string(&opts, "title=1:readahead=1:readahead_size=64", "=", ":", 0) >= 0 &&
+         avio_open2(&pb, "dvd:synthetic", AVIO_FLAG_READ | AVIO_FLAG_DIRECT, &int_cb, &opts) >= 0;
+    av_dict_free(&opts);
+    if (ok) {
+        deadline = av_gettime_relative() + 50000;
+        ret = avio_read(pb, buf, sizeof(buf));
+        ok = ret == AVERROR_EXIT && av_gettime_relative() - deadline < 500000;
+    }
+    avio_closep(&pb);
+    read_delay = 0;
+    report("readahead, interrupt while waiting", ok);
+}
+#endif
+
+/* title 1 plays sectors 2000-2499 before 1000-1499 */
+static void check_reorder(void)
+{
+    static const uint32_t title1[] = { 0, 499, 500, 999, 2000, 2499, 1000, 1499 };
+    AVIOContext *pb = NULL;
+    AVDictionary *opts = NULL;
+    AVIOInterruptCB int_cb = { interrupt_at, NULL };
+    int64_t size, reordered = -1, stop;
+    uint8_t *ref = expected(1, title1, 4, &size);
+    uint8_t buf[65536];
+    int ok, ret = 0;
+
+    backward_reads = next_offset = 0;
+    report("title 1, one backward read in playback order", check_read("title=1", 65536, 1, title1, 4) && backward_reads == 1);
+
+    /* the fourth cell is read ahead of the third, so reads only go forward */
+    backward_reads = next_offset = 0;
+    ok = open_title(&pb, "title=1:reorder_size=1024000") >= 0 && read_compare(pb, 65536, ref, size) &&
+         av_opt_get_int(pb, "cells_reordered", AV_OPT_SEARCH_CHILDREN, &reordered) >= 0;
+    avio_closep(&pb);
+    report("title 1, reorder_size", ok && reordered == 1 && !backward_reads);
+
+    /* too small for the fourth cell, which is read in its turn */
+    backward_reads = next_offset = 0;
+    ok = open_title(&pb, "title=1:reorder_size=1000000") >= 0 && read_compare(pb, 65536, ref, size) &&
+         av_opt_get_int(pb, "cells_reordered", AV_OPT_SEARCH_CHILDREN, &reordered) >= 0;
+    avio_closep(&pb);
+    report("title 1, reorder_size too small", ok && reordered == 0 && backward_reads == 1);
+#if HAVE_THREADS
+    report("title 1, reorder_size, readahead",
+           check_read("title=1:reorder_size=1024000:readahead=1:readahead_size=64", 7000, 1, title1, 4));
+    report("title 1, reorder_size, readahead, seeks",
+           check_seek("title=1:reorder_size=1024000:readahead=1:readahead_size=64", 1, title1, 4));
+#endif
+
+    /* interrupted 50 sectors into the cell read ahead */
+    ok = av_dict_parse_string(&opts, "title=1:reorder_size=1024000:blocks_per_read=10", "=", ":", 0) >= 0;
+    stop = sectors_served + 1050;
+    int_cb.opaque = &stop;
+    ok = ok && avio_open2(&pb, "dvd:synthetic", AVIO_FLAG_READ | AVIO_FLAG_DIRECT, &int_cb, &opts) >= 0;
+    av_dict_free(&opts);
+    while (ok && (ret = avio_read(pb, buf, sizeof(buf))) > 0) {
+    }
+    report("title 1, interrupt while reordering", ok && ret == AVERROR_EXIT && sectors_served - stop < 10);
+    avio_closep(&pb);
+    av_free(ref);
+}
+
+static int check_dropped(const char *options, int buf_size, const uint32_t *ranges, int nb_ranges)
+{
+    AVIOContext *pb = NULL;
+    int64_t size;
+    uint8_t *ref = expected(1, ranges, nb_ranges, &size);
+    int ok;
+
+    if (open_title(&pb, options) < 0) {
+        av_free(ref);
+        return 0;
+    }
+    /* the planned size until a sector is dropped, unknown after */
+    ok = read_compare(pb, buf_size, ref, size) && avio_size(pb) < 0;
+    avio_closep(&pb);
+    av_free(ref);
+    return ok;
+}
+
+/* sectors 1010-1012 of title set 1 are bad, in the last cell of title 1 chapter 2 on */
+static void check_bad_sectors(void)
+{
+    static const uint32_t dropped[] = { 2000, 2499, 1000, 1009, 1013, 1499 };
+    AVIOContext *pb = NULL;
+    uint8_t buf[SECTOR], buf8[8 * SECTOR];
+    int64_t short_reads = -1, bad_sectors = -1, size;
+    uint8_t *skipped = NULL, *ref = expected(1, dropped, 3, &size);
+    int i, ok;
+
+    bad_title_set = 1;
+    bad_first = 1010;
+    bad_last = 1012;
+
+    report("dropped sectors", check_dropped("title=1:chapter_start=2:bad_sector=drop:retries=0:skip_sectors=1",
+                                            65536, dropped, 3));
+#if HAVE_THREADS
+    report("dropped sectors, readahead", check_dropped("title=1:chapter_start=2:bad_sector=drop:retries=0:"
+                                                       "skip_sectors=1:readahead=1:readahead_size=64",
+                                                       7000, dropped, 3));
+
+    /* published by the demuxing thread while the worker keeps reading */
+    ok = open_title(&pb, "title=1:chapter_start=2:retries=0:skip_sectors=1:readahead=1:readahead_size=64") >= 0;
+    while (ok && avio_read(pb, buf, sizeof(buf)) > 0) {
+        uint8_t *ranges = NULL;
+
+        ok = av_opt_get(pb, "skipped_ranges", AV_OPT_SEARCH_CHILDREN, &ranges) >= 0;
+        av_free(ranges);
+    }
+    ok = ok && av_opt_get(pb, "skipped_ranges", AV_OPT_SEARCH_CHILDREN, &skipped) >= 0 &&
+         skipped && !strcmp((char *)skipped, "1010-1012") &&
+         av_opt_get_int(pb, "bad_sectors", AV_OPT_SEARCH_CHILDREN, &bad_sectors) >= 0 && bad_sectors == 3;
+    av_freep(&skipped);
+    avio_closep(&pb);
+    report("skipped ranges, readahead", ok);
+#endif
+
+    /* 613 sectors in is sector 1116 of the disc but 1113 of the read plan */
+    ok = open_title(&pb, "title=1:chapter_start=2:bad_sector=drop:retries=0:skip_sectors=1") >= 0;
+    for (i = 0; i < 613 && ok; i++) {
+        ok = avio_read(pb, buf, sizeof(buf)) == sizeof(buf);
+    }
+    ok = ok && (buf[2] << 8 | buf[3]) == 1115;
+    ok = ok && avio_seek(pb, 613 * SECTOR, SEEK_SET) == 613 * SECTOR;
+    ok = ok && avio_seek(pb, 0, SEEK_SET) == AVERROR(ESPIPE);
+    ok = ok && avio_read(pb, buf, sizeof(buf)) == sizeof(buf) && (buf[2] << 8 | buf[3]) == 1116;
+    avio_closep(&pb);
+    report("dropped sectors, seeks refused", ok);
+
+    /* the window holds everything read, so rereading it leads back to the disc cursor */
+    ok = open_title(&pb, "title=1:chapter_start=2:bad_sector=drop:retries=0:skip_sectors=1:probe_window=2097152") >= 0;
+    for (i = 0; i < 600 && ok; i++) {
+        ok = avio_read(pb, buf, sizeof(buf)) == sizeof(buf);
+    }
+    ok = ok && avio_seek(pb, 0, SEEK_SET) == 0 && read_compare(pb, 65536, ref, size);
+    avio_closep(&pb);
+    report("dropped sectors, probe window rewind", ok);
+
+    /* the window ends before the disc cursor, it cannot be left again */
+    ok = open_title(&pb, "title=1:chapter_start=2:bad_sector=drop:retries=0:skip_sectors=1:probe_window=1048576") >= 0;
+    for (i = 0; i < 600 && ok; i++) {
+        ok = avio_read(pb, buf, sizeof(buf)) == sizeof(buf);
+    }
+    ok = ok && avio_seek(pb, 0, SEEK_SET) == AVERROR(ESPIPE);
+    ok = ok && avio_read(pb, buf, sizeof(buf)) == sizeof(buf) && !memcmp(buf, ref + 600 * SECTOR, sizeof(buf));
+    avio_closep(&pb);
+    report("dropped sectors, probe window past", ok);
+
+    /* a cache miss reads ahead to the end of the extent, and into sector 63 */
+    bad_title_set = 2;
+    bad_first = bad_last = 63;
+    ok = open_title(&pb, "title=3:sector_cache=1048576:retries=0") >= 0;
+    for (i = 0; i < 56 && ok; i += 8) {
+        ok = avio_read(pb, buf8, sizeof(buf8)) == sizeof(buf8) && (buf8[2] << 8 | buf8[3]) == i &&
+             (buf8[7 * SECTOR + 2] << 8 | buf8[7 * SECTOR + 3]) == i + 7;
+    }
+    ok = ok && av_opt_get_int(pb, "short_reads", AV_OPT_SEARCH_CHILDREN, &short_reads) >= 0;
+    avio_closep(&pb);
+    report("sector cache, bad sector past the reads", ok && short_reads <= 1);
+
+    bad_title_set = 0;
+    av_free(ref);
+}
+
+static void remove_dir(const char *path)
+{
+    char name[1024];
+    struct dirent *e;
+    DIR *dir = opendir(path);
+
+    while (dir && (e = readdir(dir))) {
+        if (strcmp(e->d_name, ".") && strcmp(e->d_name, "..")) {
+            snprintf(name, sizeof(name), "%s/%s", path, e->d_name);
+            unlink(name);
+        }
+    }
+    if (dir) {
+        closedir(dir);
+    }
+    rmdir(path);
+}
+
+static void check_ifo_cache(void)
+{
+    static const uint32_t title1[] = { 0, 499, 500, 999, 2000, 2499, 1000, 1499 };
+    static const uint32_t title3[] = { 0, 99, 100, 199, 300, 999 };
+    char dir[] = "/tmp/dvdtestXXXXXX", options[128];
+
+    if (!mkdtemp(dir)) {
+        printf("%-40s %s\n", "IFO cache", "skipped");
+        return;
+    }
+    snprintf(options, sizeof(options), "ifo_cache_dir=%s", dir);
+
+    report("IFO cache, written", check_read(options, 65536, 1, title1, 4));
+    report("IFO cache, read", check_read(options, 65536, 1, title1, 4));
+    remove_dir(dir);
+
+    /* title 3 is empty in the cache written while its IFO failed */
+    if (!mkdtemp(strcpy(dir, "/tmp/dvdtestXXXXXX"))) {
+        return;
+    }
+    snprintf(options, sizeof(options), "ifo_cache_dir=%s", dir);
+    broken_ifo = 2;
+    report("IFO cache, title set 2 broken", check_read(options, 65536, 1, title1, 4));
+    broken_ifo = 0;
+    snprintf(options, sizeof(options), "ifo_cache_dir=%s:title=3", dir);
+    report("IFO cache, empty title read again", check_read(options, 65536, 2, title3, 3));
+    remove_dir(dir);
+}
+
+static int compare_file(const char *path, const uint8_t *ref, int64_t ref_size)
+{
+    uint8_t buf[SECTOR];
+    int64_t pos = 0;
+    size_t n;
+    int ok = 1;
+    FILE *f = fopen(path, "rb");
+
+    if (!f) {
+        return 0;
+    }
+    while (ok && (n = fread(buf, 1, sizeof(buf), f)) > 0) {
+        ok = pos + n <= ref_size && !memcmp(buf, ref + pos, n);
+        pos += n;
+    }
+    fclose(f);
+    return ok && pos == ref_size;
+}
+
+/* every title written in one pass, each byte for byte what reading it gives */
+static void check_extract(void)
+{
+    static const uint32_t title1[] = { 0, 499, 500, 999, 2000, 2499, 1000, 1499 };
+    static const uint32_t title2[] = { 2500, 2999 };
+    static const uint32_t title3[] = { 0, 99, 100, 199, 300, 999 };
+    static const uint32_t title4[] = { 1500, 1999, 2500, 2999 };
+    static const uint32_t title5[] = { 0, 199, 200, 299, 300, 399 };
+    static const struct {
+        int title_set;
+        const uint32_t *ranges;
+        int nb_ranges;
+    } titles[] = {
+        { 1, title1, 4 }, { 1, title2, 1 }, { 2, title3, 3 }, { 1, title4, 2 }, { 1, title5, 3 },
+    };
+    char dir[] = "/tmp/dvdtestXXXXXX", options[128], path[1024], ref_extracted[128];
+    AVIOContext *pb = NULL;
+    uint8_t *extracted = NULL;
+    int64_t served, size, sizes[FF_ARRAY_ELEMS(titles)];
+    int i, j, len = 0, ok;
+
+    if (!mkdtemp(dir)) {
+        printf("%-40s %s\n", "extract_titles", "skipped");
+        return;
+    }
+
+    served = sectors_served;
+    snprintf(options, sizeof(options), "extract_titles=all:extract_output=%s/%%d.vob", dir);
+    ok = open_title(&pb, options) >= 0 &&
+         av_opt_get(pb, "extracted", AV_OPT_SEARCH_CHILDREN, &extracted) >= 0 && extracted;
+    avio_closep(&pb);
+    /* title sets 1 and 2 are read once each, less sectors 200-299 of the second */
+    report("extract_titles, each sector read once", ok && sectors_served - served == 3900);
+
+    for (i = 0; i < FF_ARRAY_ELEMS(titles); i++) {
+        uint8_t *ref = expected(titles[i].title_set, titles[i].ranges, titles[i].nb_ranges, &size);
+
+        snprintf(path, sizeof(path), "%s/%d.vob", dir, i + 1);
+        ok = ok && ref && compare_file(path, ref, size);
+        sizes[i] = size;
+        av_free(ref);
+    }
+    report("extract_titles, outputs", ok);
+
+    /* listed in the order the title sets were read */
+    for (j = 1; j <= 2; j++) {
+        for (i = 0; i < FF_ARRAY_ELEMS(titles); i++) {
+            if (titles[i].title_set == j) {
+                len += snprintf(ref_extracted + len, sizeof(ref_extracted) - len, "%s%d:%"PRId64,
+                                len ? " " : "", i + 1, sizes[i]);
+            }
+        }
+    }
+    report("extract_titles, extracted", ok && !strcmp((char *)extracted, ref_extracted));
+    av_free(extracted);
+    remove_dir(dir);
+
+    /* only the titles asked for, title 4 plays one cell of title 2 */
+    if (!mkdtemp(strcpy(dir, "/tmp/dvdtestXXXXXX"))) {
+        return;
+    }
+    served = sectors_served;
+    snprintf(options, sizeof(options), "extract_titles=4,2:extract_output=%s/%%d.vob", dir);
+    ok = open_title(&pb, options) >= 0;
+    avio_closep(&pb);
+    for (i = 0; i < FF_ARRAY_ELEMS(titles); i++) {
+        uint8_t *ref = expected(titles[i].title_set, titles[i].ranges, titles[i].nb_ranges, &size);
+
+        snprintf(path, sizeof(path), "%s/%d.vob", dir, i + 1);
+        ok = ok && ref && (i == 1 || i == 3 ? compare_file(path, ref, size) : access(path, F_OK) < 0);
+        av_free(ref);
+    }
+    report("extract_titles, a title list", ok && sectors_served - served == 1000);
+    remove_dir(dir);
+}
+
+/* an open of the old disc must not keep its reader or cached sectors alive for the new one */
+static void check_media_change(void)
+{
+    static const uint32_t title1[] = { 0, 499, 500, 999, 2000, 2499, 1000, 1499 };
+    AVIOContext *pb = NULL, *pb2 = NULL;
+    int ok;
+
+    ok = open_title(&pb, "title=1:sector_cache=4194304") >= 0 &&
+         check_read("title=1:sector_cache=4194304", 65536, 1, title1, 4);
+    media++;
+    ok = ok && check_read("title=1:sector_cache=4194304", 65536, 1, title1, 4);
+    ok = ok && open_title(&pb2, "title=1") >= 0 && open_readers == 2;
+    avio_closep(&pb2);
+    media--;
+    avio_closep(&pb);
+    report("media change, new reader and sectors", ok);
+}
+
+static long resident_pages(void)
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    long size, resident = -1;
+
+    if (!f) {
+        return -1;
+    }
+    if (fscanf(f, "%ld %ld", &size, &resident) != 2) {
+        resident = -1;
+    }
+    fclose(f);
+    return resident;
+}
+
+/* every other open fails after the title set is opened, to cover the error path */
+static void check_open_close(void)
+{
+    AVIOContext *pb = NULL;
+    uint8_t buf[SECTOR];
+    long before = -1, after;
+    int i, ok = 1;
+
+    for (i = 0; i < 10000 && ok; i++) {
+        if (i == 1000) {
+            before = resident_pages();
+        }
+        if (i & 1) {
+            ok = open_title(&pb, "title=1:chapter_start=9") < 0;
+        } else {
+            ok = open_title(&pb, "title=1:chapter_start=2") >= 0 && avio_read(pb, buf, sizeof(buf)) == sizeof(buf);
+            avio_closep(&pb);
+        }
+        ok = ok && !open_readers && !open_files && !open_ifos;
+    }
+    report("10000 opens, all handles released", ok);
+
+    after = resident_pages();
+    if (before < 0 || after < 0) {
+        printf("%-40s %s\n", "10000 opens, resident memory", "skipped");
+        return;
+    }
+    /*
+     * after the first 1000 opens, allow 1 MiB of 4 KiB pages for allocator
+     * noise; builds with a sanitizer quarantining freed memory fail this
+     */
+    report("10000 opens, resident memory flat", after - before <= 256);
+}
+
+int main(int argc, char **argv)
+{
+    check_titles();
+    check_chapters();
+    check_seeks();
+    check_reorder();
+#if HAVE_THREADS
+    check_readahead_interrupt();
+#endif
+    check_probe_window();
+    check_time_seeks();
+    check_vobu_index();
+    check_bad_sectors();
+    check_ifo_cache();
+    check_extract();
+    check_media_change();
+    check_open_close();
+
+    report("no handles left open", !open_readers && !open_files && !open_ifos);
+
+    return !!failures;
+}